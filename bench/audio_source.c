@@ -0,0 +1,220 @@
+#include "audio_source.h"
+#include "capture.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t read_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t read_u16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+void audio_source_synthetic(AudioSource *source, unsigned int rate)
+{
+    memset(source, 0, sizeof(*source));
+    source->rate = rate;
+    source->channels = 2;
+    source->format = 16;
+    source->noise_state = 0x12345678u;
+}
+
+bool audio_source_open_wav(AudioSource *source, const char *path)
+{
+    memset(source, 0, sizeof(*source));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    unsigned char header[12];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "RIFF", 4) != 0 ||
+        memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        fprintf(stderr, "%s is not a RIFF/WAVE file\n", path);
+        fclose(file);
+        return false;
+    }
+
+    bool have_format = false;
+    unsigned char chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk))
+    {
+        uint32_t size = read_u32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+        {
+            unsigned char fmt[40] = {0};
+            size_t wanted = size < sizeof(fmt) ? size : sizeof(fmt);
+            if (fread(fmt, 1, wanted, file) != wanted)
+                break;
+            fseek(file, (long)(size - wanted + (size & 1)), SEEK_CUR);
+
+            uint16_t tag = read_u16(fmt);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 26)
+                tag = read_u16(fmt + 24); // First two bytes of the sub-format GUID
+            source->channels = read_u16(fmt + 2);
+            source->rate = read_u32(fmt + 4);
+            source->format = read_u16(fmt + 14);
+            source->ieee_float = tag == WAVE_FORMAT_IEEE_FLOAT;
+
+            bool pcm16 = tag == WAVE_FORMAT_PCM && source->format == 16;
+            bool float32 = tag == WAVE_FORMAT_IEEE_FLOAT && source->format == 32;
+            if ((!pcm16 && !float32) || source->channels < 1 || source->channels > 2)
+            {
+                fprintf(stderr, "%s: only mono/stereo PCM16 or float32 is supported\n", path);
+                break;
+            }
+            have_format = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0 && have_format)
+        {
+            size_t frame_bytes = audio_source_frame_bytes(source);
+            source->data_frames = size / frame_bytes;
+            source->data = malloc(source->data_frames * frame_bytes);
+            if (source->data == NULL ||
+                fread(source->data, frame_bytes, source->data_frames, file) != source->data_frames ||
+                source->data_frames == 0)
+            {
+                fprintf(stderr, "%s: could not read the sample data\n", path);
+                break;
+            }
+            fclose(file);
+            return true;
+        }
+        else
+        {
+            fseek(file, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+
+    if (!have_format)
+        fprintf(stderr, "%s: missing fmt or data chunk\n", path);
+    fclose(file);
+    audio_source_close(source);
+    return false;
+}
+
+bool audio_source_open_capture(AudioSource *source, const char *path)
+{
+    memset(source, 0, sizeof(*source));
+
+    char error[256];
+    struct cava_capture_info info;
+    struct cava_capture *capture = cava_capture_open(path, &info, error, sizeof(error));
+    if (capture == NULL)
+    {
+        fprintf(stderr, "%s\n", error);
+        return false;
+    }
+    source->rate = info.rate;
+    source->channels = info.channels;
+    source->format = info.format;
+    source->ieee_float = info.IEEE_FLOAT;
+    source->sample_bytes = info.sample_bytes;
+
+    size_t frame_bytes = audio_source_frame_bytes(source);
+    size_t size = 0;
+    size_t capacity = 0;
+    struct cava_capture_record record;
+    int status;
+    while ((status = cava_capture_read(capture, &record)) > 0)
+    {
+        if (record.type != CAVA_CAPTURE_AUDIO)
+            continue;
+        if (size + record.payload_bytes > capacity)
+        {
+            capacity = 2 * capacity > size + record.payload_bytes ? 2 * capacity : size + record.payload_bytes;
+            unsigned char *data = realloc(source->data, capacity);
+            if (data == NULL)
+            {
+                status = -1;
+                break;
+            }
+            source->data = data;
+        }
+        memcpy(source->data + size, record.payload, record.payload_bytes);
+        size += record.payload_bytes;
+    }
+    cava_capture_close(capture);
+
+    // Blocks always hold whole frames, so a partial one can only come from a damaged file
+    source->data_frames = size / frame_bytes;
+    if (status < 0 || source->data_frames == 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, status < 0 ? "truncated or corrupt capture" : "no audio in the capture");
+        audio_source_close(source);
+        return false;
+    }
+    return true;
+}
+
+void audio_source_close(AudioSource *source)
+{
+    free(source->data);
+    source->data = NULL;
+    source->data_frames = 0;
+}
+
+size_t audio_source_frame_bytes(const AudioSource *source)
+{
+    int sample_bytes = source->sample_bytes > 0 ? source->sample_bytes : source->format / 8;
+    return source->channels * (size_t)sample_bytes;
+}
+
+static void synthesize(AudioSource *source, int16_t *out, size_t frames)
+{
+    static const double frequencies[] = {55.0, 110.0, 440.0, 1760.0};
+    static const double amplitudes[] = {6000.0, 4000.0, 2500.0, 1200.0};
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        double t = (double)source->frame_index++ / source->rate;
+        // A slow amplitude envelope keeps the smoothing filters from settling into a steady state
+        double envelope = 0.6 + 0.4 * sin(2.0 * M_PI * 0.5 * t);
+
+        double mid = 0.0;
+        for (size_t k = 0; k < sizeof(frequencies) / sizeof(frequencies[0]); k++)
+            mid += amplitudes[k] * sin(2.0 * M_PI * frequencies[k] * t);
+
+        for (unsigned int c = 0; c < source->channels; c++)
+        {
+            source->noise_state = source->noise_state * 1664525u + 1013904223u;
+            double noise = ((double)(source->noise_state >> 16) / 32768.0 - 1.0) * 800.0;
+            double value = envelope * mid * (c == 0 ? 1.0 : 0.8) + noise;
+            out[i * source->channels + c] = (int16_t)value;
+        }
+    }
+}
+
+void audio_source_read(AudioSource *source, unsigned char *out, size_t frames)
+{
+    if (source->data == NULL)
+    {
+        synthesize(source, (int16_t *)out, frames);
+        return;
+    }
+
+    size_t frame_bytes = audio_source_frame_bytes(source);
+    while (frames > 0)
+    {
+        size_t run = source->data_frames - source->position;
+        if (run > frames)
+            run = frames;
+        memcpy(out, source->data + source->position * frame_bytes, run * frame_bytes);
+        out += run * frame_bytes;
+        frames -= run;
+        source->position = (source->position + run) % source->data_frames;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef AUDIO_SOURCE_H
+#define AUDIO_SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Deterministic audio for ywp-bench: a synthetic signal, or a WAV file or the audio of a capture played in a loop.
+// Samples come out interleaved in the format described by `format`/`ieee_float`/`sample_bytes`, exactly like a
+// capture backend would hand them to write_to_cava_input_buffers.
+typedef struct
+{
+    unsigned int rate;
+    unsigned int channels;
+    int format;     // Bits per sample
+    int ieee_float; // 32 bit samples are float when set
+    int sample_bytes; // Bytes per sample, 0 means format / 8
+
+    // WAV playback, NULL for the synthetic source
+    unsigned char *data;
+    size_t data_frames;
+    size_t position;
+
+    // Synthetic source state
+    uint64_t frame_index;
+    uint32_t noise_state;
+} AudioSource;
+
+// Stereo 16 bit signal: a handful of sines sweeping through the bass and mid bands plus seeded noise, so every
+// run feeds cava the exact same samples
+void audio_source_synthetic(AudioSource *source, unsigned int rate);
+// Loads a PCM16 or float32 WAV file with one or two channels
+bool audio_source_open_wav(AudioSource *source, const char *path);
+// Loads the audio blocks of a capture file (see capture.h) back to back, dropping the timing
+bool audio_source_open_capture(AudioSource *source, const char *path);
+void audio_source_close(AudioSource *source);
+
+size_t audio_source_frame_bytes(const AudioSource *source);
+// Fills `out` with the next `frames` interleaved frames
+void audio_source_read(AudioSource *source, unsigned char *out, size_t frames);
+
+#endif // AUDIO_SOURCE_H
@@ -0,0 +1,531 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_source.h"
+#include "bar_buffer.h"
+#include "bar_history.h"
+#include "capture.h"
+#include "cavacore.h"
+#include "config.h"
+#include "dsp.h"
+#include "platform.h"
+#include "program_cache.h"
+#include "renderer.h"
+
+#define DEFAULT_FRAMES 1000
+#define DEFAULT_WARMUP 60
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define DEFAULT_RATE 60
+#define SYNTHETIC_SAMPLE_RATE 44100
+#define RING_CAPACITY 16384
+#define DEFAULT_TOLERANCE 1e-4
+
+typedef enum
+{
+    STAGE_DSP,
+    STAGE_UPLOAD,
+    STAGE_DRAW,
+    STAGE_SWAP,
+    STAGE_COUNT,
+} Stage;
+
+static const char *stage_names[STAGE_COUNT] = {"dsp", "upload", "draw", "swap"};
+
+typedef struct
+{
+    int frames;
+    int warmup;
+    int width;
+    int height;
+    int bars;
+    int rate;
+    const char *theme;
+    const char *wav;
+    const char *capture; // Capture whose audio replaces the synthetic signal
+    const char *record;  // Capture file receiving the fed audio and the bars of every frame
+    const char *compare; // Golden capture the bars of every frame are checked against
+    double tolerance;
+    bool sync;
+} BenchConfig;
+
+// Running result of --compare
+typedef struct
+{
+    struct cava_capture *golden;
+    double tolerance;
+    int frames;      // Frames compared
+    int mismatches;  // Frames with at least one bar off by more than the tolerance
+    double max_diff; // Largest difference seen, at `max_frame`/`max_bar`
+    int max_frame;
+    int max_bar;
+    const char *error; // Set once the golden file cannot be followed any further
+} Comparison;
+
+static double get_monotonic_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void print_usage(const char *program)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Runs the analysis and render pipeline offscreen and reports per-stage timings.\n"
+           "\n"
+           "Options:\n"
+           "  -n, --frames <count>    Measured frames (default %d)\n"
+           "  -u, --warmup <count>    Frames run before measuring (default %d)\n"
+           "  -W, --width <px>        Offscreen surface width (default %d)\n"
+           "  -H, --height <px>       Offscreen surface height (default %d)\n"
+           "  -t, --theme <name>      Visualizer to draw (default %s)\n"
+           "  -b, --bars <count>      Bars per channel (default %d)\n"
+           "  -r, --rate <hz>         Frames per second of audio fed per frame (default %d)\n"
+           "  -w, --wav <file>        Play a PCM16/float32 WAV file instead of the synthetic signal\n"
+           "  -c, --capture <file>    Play the audio of a capture file (ywp --record) instead\n"
+           "  -R, --record <file>     Write the fed audio and the bars of every frame to a capture file\n"
+           "  -C, --compare <file>    Check the bars of every frame against a capture written by --record\n"
+           "                          of ywp-bench, at the same --rate (ywp --record follows live timing)\n"
+           "  -e, --tolerance <x>     Largest bar difference --compare accepts (default %g)\n"
+           "  -s, --sync              glFinish after each draw so it measures GPU time, not submission\n"
+           "  -h, --help              Show this message\n",
+           program, DEFAULT_FRAMES, DEFAULT_WARMUP, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_THEME, DEFAULT_BARS_PER_CHANNEL,
+           DEFAULT_RATE, DEFAULT_TOLERANCE);
+}
+
+static bool parse_int(const char *value, int min, int *out)
+{
+    char *end = NULL;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < min)
+        return false;
+    *out = (int)parsed;
+    return true;
+}
+
+static bool parse_double(const char *value, double min, double *out)
+{
+    char *end = NULL;
+    double parsed = strtod(value, &end);
+    if (end == value || *end != '\0' || parsed < min)
+        return false;
+    *out = parsed;
+    return true;
+}
+
+static bool parse_bench_config(BenchConfig *config, int argc, char **argv, int *exit_code)
+{
+    *config = (BenchConfig){
+        .frames = DEFAULT_FRAMES,
+        .warmup = DEFAULT_WARMUP,
+        .width = DEFAULT_WIDTH,
+        .height = DEFAULT_HEIGHT,
+        .bars = DEFAULT_BARS_PER_CHANNEL,
+        .rate = DEFAULT_RATE,
+        .theme = DEFAULT_THEME,
+        .tolerance = DEFAULT_TOLERANCE,
+    };
+
+    static const struct option options[] = {
+        {"frames", required_argument, NULL, 'n'},
+        {"warmup", required_argument, NULL, 'u'},
+        {"width", required_argument, NULL, 'W'},
+        {"height", required_argument, NULL, 'H'},
+        {"theme", required_argument, NULL, 't'},
+        {"bars", required_argument, NULL, 'b'},
+        {"rate", required_argument, NULL, 'r'},
+        {"wav", required_argument, NULL, 'w'},
+        {"capture", required_argument, NULL, 'c'},
+        {"record", required_argument, NULL, 'R'},
+        {"compare", required_argument, NULL, 'C'},
+        {"tolerance", required_argument, NULL, 'e'},
+        {"sync", no_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:u:W:H:t:b:r:w:c:R:C:e:sh", options, NULL)) != -1)
+    {
+        bool valid = true;
+        switch (opt)
+        {
+        case 'n':
+            valid = parse_int(optarg, 1, &config->frames);
+            break;
+        case 'u':
+            valid = parse_int(optarg, 0, &config->warmup);
+            break;
+        case 'W':
+            valid = parse_int(optarg, 1, &config->width);
+            break;
+        case 'H':
+            valid = parse_int(optarg, 1, &config->height);
+            break;
+        case 't':
+            config->theme = optarg;
+            break;
+        case 'b':
+            valid = parse_int(optarg, 1, &config->bars);
+            break;
+        case 'r':
+            valid = parse_int(optarg, 1, &config->rate);
+            break;
+        case 'w':
+            config->wav = optarg;
+            break;
+        case 'c':
+            config->capture = optarg;
+            break;
+        case 'R':
+            config->record = optarg;
+            break;
+        case 'C':
+            config->compare = optarg;
+            break;
+        case 'e':
+            valid = parse_double(optarg, 0.0, &config->tolerance);
+            break;
+        case 's':
+            config->sync = true;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            *exit_code = 0;
+            return false;
+        default:
+            print_usage(argv[0]);
+            *exit_code = 1;
+            return false;
+        }
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+            *exit_code = 1;
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of an already sorted array
+static double percentile(const double *sorted, int count, double p)
+{
+    int rank = (int)(p * count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > count)
+        rank = count;
+    return sorted[rank - 1];
+}
+
+static void report(double *samples[STAGE_COUNT], int count)
+{
+    printf("%-8s %10s %10s %10s %10s\n", "stage", "p50 (ms)", "p99 (ms)", "mean (ms)", "max (ms)");
+    double total_mean = 0.0;
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        qsort(samples[s], count, sizeof(double), compare_doubles);
+        double sum = 0.0;
+        for (int i = 0; i < count; i++)
+            sum += samples[s][i];
+        double mean = sum / count;
+        total_mean += mean;
+        printf("%-8s %10.4f %10.4f %10.4f %10.4f\n", stage_names[s], percentile(samples[s], count, 0.50) * 1e3,
+               percentile(samples[s], count, 0.99) * 1e3, mean * 1e3, samples[s][count - 1] * 1e3);
+    }
+    printf("%-8s %10s %10s %10.4f\n", "total", "", "", total_mean * 1e3);
+}
+
+// Checks one frame of bars against the next bar frame of the golden capture
+static void compare_bars(Comparison *comparison, const float *bars, int num_bars, int frame)
+{
+    if (comparison->error != NULL)
+        return;
+
+    struct cava_capture_record record;
+    int status;
+    while ((status = cava_capture_read(comparison->golden, &record)) > 0 && record.type != CAVA_CAPTURE_BARS)
+        ;
+    if (status <= 0)
+    {
+        comparison->error = status < 0 ? "truncated or corrupt" : "ends before the run";
+        return;
+    }
+    if ((int)record.count != num_bars)
+    {
+        comparison->error = "holds a different number of bars";
+        return;
+    }
+
+    const float *golden = record.payload;
+    bool mismatch = false;
+    for (int i = 0; i < num_bars; i++)
+    {
+        double diff = fabs((double)bars[i] - golden[i]);
+        if (diff > comparison->max_diff)
+        {
+            comparison->max_diff = diff;
+            comparison->max_frame = frame;
+            comparison->max_bar = i;
+        }
+        mismatch |= diff > comparison->tolerance;
+    }
+    comparison->mismatches += mismatch;
+    comparison->frames++;
+}
+
+// Pushes `frames` frames through the same entry point the capture backends use, at most a ring's worth at a time
+static void feed_audio(struct audio_data *audio, AudioSource *source, unsigned char *scratch, size_t frames)
+{
+    size_t max_frames = RING_CAPACITY / source->channels;
+    while (frames > 0)
+    {
+        size_t block = frames < max_frames ? frames : max_frames;
+        audio_source_read(source, scratch, block);
+        write_to_cava_input_buffers((int)(block * source->channels), scratch, audio);
+        frames -= block;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+    int exit_code = 0;
+    if (!parse_bench_config(&config, argc, argv, &exit_code))
+        return exit_code;
+
+    AudioSource source;
+    if (config.capture)
+    {
+        if (!audio_source_open_capture(&source, config.capture))
+            return 1;
+    }
+    else if (config.wav)
+    {
+        if (!audio_source_open_wav(&source, config.wav))
+            return 1;
+    }
+    else
+    {
+        audio_source_synthetic(&source, SYNTHETIC_SAMPLE_RATE);
+    }
+
+    if (!init_headless_platform(config.width, config.height))
+    {
+        fprintf(stderr, "Could not create an offscreen GLES 3.1 context\n");
+        return 1;
+    }
+
+    struct audio_data audio = {0};
+    audio.format = source.format;
+    audio.IEEE_FLOAT = source.ieee_float;
+    audio.sample_bytes = source.sample_bytes;
+    audio.rate = source.rate;
+    audio.channels = source.channels;
+    audio.cava_buffer_size = RING_CAPACITY;
+    if (init_cava_input_ring(&audio.ring, audio.cava_buffer_size) != 0)
+    {
+        fprintf(stderr, "Could not allocate the input ring\n");
+        return 1;
+    }
+
+    // Analysed like ywp at its defaults, so the bench measures and compares what ywp runs
+    struct cava_plan *plan = cava_init(config.bars, audio.rate, audio.channels, 0, DEFAULT_NOISE_REDUCTION,
+                                       DEFAULT_LOW_CUT_OFF, DEFAULT_HIGH_CUT_OFF);
+    if (plan->status != 0)
+    {
+        fprintf(stderr, "Error initializing cava: %s\n", plan->error_message);
+        return 1;
+    }
+
+    // Built-in shaders only and no program cache, so runs are comparable across machines and users
+    Theme theme;
+    if (!find_theme(config.theme, NULL, &theme))
+    {
+        fprintf(stderr, "Unknown theme '%s' (available: %s)\n", config.theme, theme_names());
+        return 1;
+    }
+
+    int num_bars = config.bars * (int)audio.channels;
+    Renderer renderer;
+    BarBuffer bar_buffer;
+    BarHistory bar_history;
+    ProgramCache program_cache;
+    program_cache_init(&program_cache, NULL);
+    GLuint program = program_cache_load_theme(&program_cache, &theme, NULL);
+    if (!renderer_init(&renderer, &theme, program, num_bars) || !bar_buffer_init(&bar_buffer, num_bars) ||
+        !bar_history_init(&bar_history, num_bars))
+    {
+        fprintf(stderr, "Error creating renderer for theme '%s'\n", theme.name);
+        return 1;
+    }
+    renderer.history = &bar_history;
+
+    // The worker thread is never started: each frame runs one analysis step inline so it can be timed
+    DspData dsp = {0};
+    if (!dsp_init(&dsp, &audio, plan, config.rate, 0.0))
+    {
+        fprintf(stderr, "Error initializing DSP\n");
+        return 1;
+    }
+
+    // Recording and comparing happen outside the timed spans; the audio is recorded by write_to_cava_input_buffers
+    // itself, exactly where ywp records it
+    // Every analysis step is fed the same number of frames, which the recording states so that --compare can tell
+    // a golden with the same steps from one recorded live
+    size_t frames_per_tick = audio.rate / config.rate;
+    char error[256];
+    struct cava_capture *recording = NULL;
+    if (config.record)
+    {
+        recording = cava_capture_create(config.record, &audio, dsp.num_bars, (int)frames_per_tick, error,
+                                        sizeof(error));
+        if (recording == NULL)
+        {
+            fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+        atomic_store_explicit(&audio.capture, recording, memory_order_release);
+    }
+    Comparison comparison = {.tolerance = config.tolerance};
+    if (config.compare)
+    {
+        struct cava_capture_info info;
+        comparison.golden = cava_capture_open(config.compare, &info, error, sizeof(error));
+        if (comparison.golden == NULL)
+        {
+            fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+
+        // Bars only line up frame by frame when both runs cut the same audio into the same steps
+        if (info.frames_per_step == 0)
+        {
+            fprintf(stderr, "%s follows the live analysis timing; --compare needs a golden from ywp-bench --record\n",
+                    config.compare);
+            return 1;
+        }
+        if (info.rate != audio.rate || (size_t)info.frames_per_step != frames_per_tick)
+        {
+            fprintf(stderr, "%s was recorded feeding %d frames at %u Hz per step, this run feeds %zu at %u Hz\n",
+                    config.compare, info.frames_per_step, info.rate, frames_per_tick, audio.rate);
+            return 1;
+        }
+    }
+
+    unsigned char *scratch = malloc(RING_CAPACITY * audio_source_frame_bytes(&source));
+    double *samples[STAGE_COUNT];
+    bool allocated = scratch != NULL;
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        samples[s] = calloc(config.frames, sizeof(double));
+        allocated = allocated && samples[s] != NULL;
+    }
+    if (!allocated)
+    {
+        fprintf(stderr, "Could not allocate the timing buffers for %d frames\n", config.frames);
+        return 1;
+    }
+
+    const char *audio_name = config.capture ? config.capture : config.wav ? config.wav : "synthetic";
+    printf("ywp-bench: %d frames at %dx%d, theme %s, %d bars, %s audio at %u Hz, %s\n", config.frames, config.width,
+           config.height, theme.name, num_bars, audio_name, audio.rate,
+           config.sync ? "synchronous draws" : "asynchronous draws");
+
+    for (int frame = -config.warmup; frame < config.frames; frame++)
+    {
+        feed_audio(&audio, &source, scratch, frames_per_tick);
+
+        double t0 = get_monotonic_time();
+        dsp_process(&dsp);
+        double t1 = get_monotonic_time();
+
+        const float *bars = dsp_acquire_bars(&dsp, NULL);
+        bar_buffer_upload(&bar_buffer, bars);
+        bar_history_push(&bar_history, bars);
+        double t2 = get_monotonic_time();
+        if (recording)
+            cava_capture_write_bars(recording, bars, num_bars);
+        if (comparison.golden)
+            compare_bars(&comparison, bars, num_bars, frame);
+
+        renderer_draw(&renderer, config.width, config.height, (float)frame / config.rate, NULL);
+        bar_buffer_fence(&bar_buffer);
+        if (config.sync)
+            glFinish();
+        double t3 = get_monotonic_time();
+
+        eglSwapBuffers(platform.egl.device, platform.egl.surface);
+        double t4 = get_monotonic_time();
+
+        if (frame >= 0)
+        {
+            samples[STAGE_DSP][frame] = t1 - t0;
+            samples[STAGE_UPLOAD][frame] = t2 - t1;
+            samples[STAGE_DRAW][frame] = t3 - t2;
+            samples[STAGE_SWAP][frame] = t4 - t3;
+        }
+    }
+    glFinish();
+
+    report(samples, config.frames);
+    unsigned long long overruns = atomic_load(&audio.ring.overruns);
+    if (overruns > 0)
+        printf("input ring overruns: %llu\n", overruns);
+
+    // Frames are numbered from the first measured one, warm-up frames are negative
+    if (comparison.golden)
+    {
+        if (comparison.error)
+        {
+            printf("compare: %s %s after %d frames\n", config.compare, comparison.error, comparison.frames);
+            exit_code = 1;
+        }
+        else
+        {
+            printf("compare: %d frames, %d over tolerance %g, max difference %g (frame %d, bar %d)\n",
+                   comparison.frames, comparison.mismatches, comparison.tolerance, comparison.max_diff,
+                   comparison.max_frame, comparison.max_bar);
+            exit_code = comparison.mismatches > 0;
+        }
+        cava_capture_close(comparison.golden);
+    }
+
+    for (int s = 0; s < STAGE_COUNT; s++)
+        free(samples[s]);
+    free(scratch);
+
+    dsp_destroy(&dsp);
+    bar_history_destroy(&bar_history);
+    bar_buffer_destroy(&bar_buffer);
+    renderer_destroy(&renderer);
+    close_platform();
+
+    // An incomplete golden would only fail the next comparison
+    if (cava_capture_close(recording) != 0)
+    {
+        fprintf(stderr, "Recording %s stopped early\n", config.record);
+        exit_code = 1;
+    }
+    free_cava_input_ring(&audio.ring);
+    audio_source_close(&source);
+    cava_destroy(plan);
+    free(plan);
+
+    return exit_code;
+}
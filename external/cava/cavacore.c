@@ -4,13 +4,216 @@
 #endif
 #include <fftw3.h>
 #include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#ifdef CAVA_SINGLE_PRECISION
+#define CAVA_FFTW(name) fftwf_##name
+#define CAVA_SQRT sqrtf
+#else
+#define CAVA_FFTW(name) fftw_##name
+#define CAVA_SQRT sqrt
+#endif
+
+// bump when the set of transforms cava_init plans changes, so stale wisdom files are ignored
+#define CAVA_WISDOM_VERSION 4
+
+// the bass fft is decimated by the largest power of two up to MAX_BASS_DECIMATION that keeps every
+// bass bin inside the passband of the decimation filter. that filter is a blackman windowed sinc
+// of DECIMATION_TAPS_PER_FACTOR * decimation taps cut off at the decimated nyquist: flat within
+// 0.02 db up to DECIMATION_PASSBAND times the decimated rate, and everything folding back onto
+// that band is attenuated by more than 70 db
+#define MAX_BASS_DECIMATION 8
+#define DECIMATION_TAPS_PER_FACTOR 8
+#define DECIMATION_PASSBAND 0.16
+
+static char wisdom_dir[1024];
+static unsigned int wisdom_flags = FFTW_MEASURE;
+
+void cava_set_wisdom_dir(const char *dir, unsigned int planner_flags) {
+    wisdom_dir[0] = '\0';
+    if (dir != NULL && strlen(dir) < sizeof(wisdom_dir))
+        strcpy(wisdom_dir, dir);
+    wisdom_flags = planner_flags;
+}
+
+// fnv-1a, only used to keep the cache file names short
+static uint64_t hash_string(uint64_t hash, const char *s) {
+    for (; *s; s++) {
+        hash ^= (unsigned char)*s;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// identifies the cpu by model and feature flags: wisdom measured on one machine is only a good
+// guess on another, and codelets for missing instructions would not run at all
+static uint64_t cpu_hash(void) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL)
+        return hash;
+
+    char line[4096];
+    bool have_model = false, have_flags = false;
+    while ((!have_model || !have_flags) && fgets(line, sizeof(line), cpuinfo) != NULL) {
+        if (!have_model && strncmp(line, "model name", 10) == 0) {
+            hash = hash_string(hash, line);
+            have_model = true;
+        } else if (!have_flags && (strncmp(line, "flags", 5) == 0 ||
+                                   strncmp(line, "Features", 8) == 0)) {
+            hash = hash_string(hash, line);
+            have_flags = true;
+        }
+    }
+    fclose(cpuinfo);
+    return hash;
+}
+
+static int fft_buffer_size_for_rate(unsigned int rate) {
+    int fft_buffer_size = 512;
+
+    if (rate > 8125 && rate <= 16250)
+        fft_buffer_size *= 2;
+    else if (rate > 16250 && rate <= 32500)
+        fft_buffer_size *= 4;
+    else if (rate > 32500 && rate <= 75000)
+        fft_buffer_size *= 8;
+    else if (rate > 75000 && rate <= 150000)
+        fft_buffer_size *= 16;
+    else if (rate > 150000 && rate <= 300000)
+        fft_buffer_size *= 32;
+    else if (rate > 300000)
+        fft_buffer_size *= 64;
+    return fft_buffer_size;
+}
+
+// fftw wisdom holds one entry per transform size and batch count, so a single file serves every
+// rate, channel count and bass decimation; only the things that make wisdom invalid name it
+int cava_wisdom_path(char *path, size_t size) {
+    if (wisdom_dir[0] == '\0')
+        return -1;
+
+    static uint64_t cpu;
+    if (cpu == 0)
+        cpu = cpu_hash();
+    uint64_t key = hash_string(cpu, CAVA_FFTW(version));
+
+#ifdef CAVA_SINGLE_PRECISION
+    const char precision = 'f';
+#else
+    const char precision = 'd';
+#endif
+    int written = snprintf(path, size, "%s/fftw-wisdom-v%d-%c-%016llx", wisdom_dir,
+                           CAVA_WISDOM_VERSION, precision, (unsigned long long)key);
+    return written > 0 && (size_t)written < size ? 0 : -1;
+}
+
+// plans howmany transforms of n points, laid out back to back in `in` and `out`. uses the
+// imported wisdom when it covers the transform, otherwise measures it and flags that the cache
+// needs to be written back
+static cava_fft_plan plan_r2c(int n, int howmany, cava_real *in, cava_complex *out,
+                              unsigned int flags, bool use_wisdom, bool *missed) {
+    if (use_wisdom) {
+        cava_fft_plan plan = CAVA_FFTW(plan_many_dft_r2c)(1, &n, howmany, in, NULL, 1, n, out, NULL,
+                                                          1, n / 2 + 1, flags | FFTW_WISDOM_ONLY);
+        if (plan != NULL)
+            return plan;
+        *missed = true;
+    }
+    return CAVA_FFTW(plan_many_dft_r2c)(1, &n, howmany, in, NULL, 1, n, out, NULL, 1, n / 2 + 1,
+                                        flags);
+}
+
+static void export_wisdom(const char *path) {
+    // write next to the target and rename, so a concurrent cava_init never imports half a file
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    if (CAVA_FFTW(export_wisdom_to_filename)(tmp) && rename(tmp, path) == 0)
+        return;
+    remove(tmp);
+}
+
+// plans a batch of `howmany` n point transforms on scratch buffers with the cache's rigor, only
+// for the wisdom it leaves behind
+static int plan_for_wisdom(int n, int howmany, bool *missed) {
+    cava_real *in = CAVA_FFTW(alloc_real)(n * howmany);
+    cava_complex *out = CAVA_FFTW(alloc_complex)((n / 2 + 1) * howmany);
+    int status = -1;
+    if (in != NULL && out != NULL) {
+        cava_fft_plan plan = plan_r2c(n, howmany, in, out, wisdom_flags, true, missed);
+        if (plan != NULL) {
+            CAVA_FFTW(destroy_plan)(plan);
+            status = 0;
+        }
+    }
+    CAVA_FFTW(free)(in);
+    CAVA_FFTW(free)(out);
+    return status;
+}
+
+int cava_generate_wisdom(unsigned int rate) {
+    char wisdom_path[1024];
+    if (cava_wisdom_path(wisdom_path, sizeof(wisdom_path)) != 0)
+        return -1;
+    CAVA_FFTW(import_wisdom_from_filename)(wisdom_path);
+
+    // the treble transform only depends on the rate, the bass one also on the decimation the bars
+    // and cut offs end up with, which can be any power of two up to MAX_BASS_DECIMATION
+    int fft_buffer_size = fft_buffer_size_for_rate(rate);
+    bool missed = false;
+    int status = 0;
+    for (int channels = 1; channels <= 2; channels++) {
+        status |= plan_for_wisdom(fft_buffer_size, channels, &missed);
+        for (int decimation = 1; decimation <= MAX_BASS_DECIMATION; decimation *= 2)
+            status |= plan_for_wisdom(fft_buffer_size * 2 / decimation, channels, &missed);
+    }
+    if (missed)
+        export_wisdom(wisdom_path);
+    return status;
+}
+
+// builds the decimation filter and the decimated histories for p->bass_decimation
+static void init_decimation(struct cava_plan *p) {
+    // a single unit tap when not decimating, the bass history is then a plain copy
+    p->decimation_taps = 1;
+    if (p->bass_decimation > 1)
+        p->decimation_taps = DECIMATION_TAPS_PER_FACTOR * p->bass_decimation;
+    p->decimation_filter = (cava_real *)malloc(p->decimation_taps * sizeof(cava_real));
+
+    double cut_off = 0.5 / p->bass_decimation; // in cycles per full rate sample
+    double centre = (p->decimation_taps - 1) / 2.0;
+    double sum = 0;
+    for (int i = 0; i < p->decimation_taps; i++) {
+        double x = i - centre;
+        double sinc = x == 0 ? 2 * cut_off : sin(2 * M_PI * cut_off * x) / (M_PI * x);
+        double window = 1;
+        if (p->decimation_taps > 1)
+            window = 0.42 - 0.5 * cos(2 * M_PI * i / (p->decimation_taps - 1)) +
+                     0.08 * cos(4 * M_PI * i / (p->decimation_taps - 1));
+        p->decimation_filter[i] = sinc * window;
+        sum += sinc * window;
+    }
+    // unity gain at dc
+    for (int i = 0; i < p->decimation_taps; i++)
+        p->decimation_filter[i] /= sum;
+
+    p->decimation_phase = 0;
+    p->bass_history_cursor = 0;
+    p->bass_history_l = (cava_real *)calloc(p->FFTbassdecimatedSize * 2, sizeof(cava_real));
+    p->bass_history_r = NULL;
+    if (p->audio_channels == 2)
+        p->bass_history_r = (cava_real *)calloc(p->FFTbassdecimatedSize * 2, sizeof(cava_real));
+}
+
 #ifdef __ANDROID__
 #include <jni.h>
 struct cava_plan *plan;
-double *cava_in;
-double *cava_out;
+cava_real *cava_in;
+cava_real *cava_out;
 #endif
 
 struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels, int autosens,
@@ -34,20 +237,7 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
         return p;
     }
 
-    int fft_buffer_size = 512;
-
-    if (rate > 8125 && rate <= 16250)
-        fft_buffer_size *= 2;
-    else if (rate > 16250 && rate <= 32500)
-        fft_buffer_size *= 4;
-    else if (rate > 32500 && rate <= 75000)
-        fft_buffer_size *= 8;
-    else if (rate > 75000 && rate <= 150000)
-        fft_buffer_size *= 16;
-    else if (rate > 150000 && rate <= 300000)
-        fft_buffer_size *= 32;
-    else if (rate > 300000)
-        fft_buffer_size *= 64;
+    int fft_buffer_size = fft_buffer_size_for_rate(rate);
 
     if (number_of_bars < 1) {
         snprintf(p->error_message, 1024,
@@ -94,86 +284,43 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
     p->frame_skip = 1;
     p->noise_reduction = noise_reduction;
 
-    int fftw_flag = FFTW_MEASURE;
+    unsigned int fftw_flag = wisdom_flags;
+    char wisdom_path[1024];
+    bool use_wisdom = cava_wisdom_path(wisdom_path, sizeof(wisdom_path)) == 0;
+    bool wisdom_missed = false;
 #ifdef __ANDROID__
     fftw_flag = FFTW_ESTIMATE;
+    use_wisdom = false;
 #endif
+    if (use_wisdom)
+        CAVA_FFTW(import_wisdom_from_filename)(wisdom_path);
 
     p->FFTbassbufferSize = fft_buffer_size * 2;
     p->FFTbufferSize = fft_buffer_size;
 
     p->input_buffer_size = p->FFTbassbufferSize * channels;
 
-    p->input_buffer = (double *)malloc(p->input_buffer_size * sizeof(double));
+    p->history_cursor = 0;
+    p->history_l = (cava_real *)calloc(p->FFTbassbufferSize * 2, sizeof(cava_real));
+    p->history_r = NULL;
+    if (channels == 2)
+        p->history_r = (cava_real *)calloc(p->FFTbassbufferSize * 2, sizeof(cava_real));
 
     p->FFTbuffer_lower_cut_off = (int *)malloc((number_of_bars + 1) * sizeof(int));
     p->FFTbuffer_upper_cut_off = (int *)malloc((number_of_bars + 1) * sizeof(int));
-    p->eq = (double *)malloc((number_of_bars + 1) * sizeof(double));
+    p->eq = (cava_real *)malloc((number_of_bars + 1) * sizeof(cava_real));
     p->cut_off_frequency = (float *)malloc((number_of_bars + 1) * sizeof(float));
 
-    p->cava_fall = (double *)malloc(number_of_bars * channels * sizeof(double));
-    p->cava_mem = (double *)malloc(number_of_bars * channels * sizeof(double));
-    p->cava_peak = (double *)malloc(number_of_bars * channels * sizeof(double));
-    p->prev_cava_out = (double *)malloc(number_of_bars * channels * sizeof(double));
-
-    // Hann Window calculate multipliers
-    p->bass_multiplier = (double *)malloc(p->FFTbassbufferSize * sizeof(double));
-    p->multiplier = (double *)malloc(p->FFTbufferSize * sizeof(double));
-    for (int i = 0; i < p->FFTbassbufferSize; i++) {
-        p->bass_multiplier[i] = 0.5 * (1 - cos(2 * M_PI * i / (p->FFTbassbufferSize - 1)));
-    }
-    for (int i = 0; i < p->FFTbufferSize; i++) {
-        p->multiplier[i] = 0.5 * (1 - cos(2 * M_PI * i / (p->FFTbufferSize - 1)));
-    }
-
-    // BASS
-    p->in_bass_l = fftw_alloc_real(p->FFTbassbufferSize);
-    p->in_bass_l_raw = fftw_alloc_real(p->FFTbassbufferSize);
-    p->out_bass_l = fftw_alloc_complex(p->FFTbassbufferSize / 2 + 1);
-    p->p_bass_l =
-        fftw_plan_dft_r2c_1d(p->FFTbassbufferSize, p->in_bass_l, p->out_bass_l, fftw_flag);
-
-    // MID + TREBLE
-    p->in_l = fftw_alloc_real(p->FFTbufferSize);
-    p->in_l_raw = fftw_alloc_real(p->FFTbufferSize);
-    p->out_l = fftw_alloc_complex(p->FFTbufferSize / 2 + 1);
-    p->p_l = fftw_plan_dft_r2c_1d(p->FFTbufferSize, p->in_l, p->out_l, fftw_flag);
-
-    memset(p->in_bass_l, 0, sizeof(double) * p->FFTbassbufferSize);
-    memset(p->in_l, 0, sizeof(double) * p->FFTbufferSize);
-    memset(p->in_bass_l_raw, 0, sizeof(double) * p->FFTbassbufferSize);
-    memset(p->in_l_raw, 0, sizeof(double) * p->FFTbufferSize);
-    memset(p->out_bass_l, 0, (p->FFTbassbufferSize / 2 + 1) * sizeof(fftw_complex));
-    memset(p->out_l, 0, (p->FFTbufferSize / 2 + 1) * sizeof(fftw_complex));
-    if (p->audio_channels == 2) {
-        // BASS
-        p->in_bass_r = fftw_alloc_real(p->FFTbassbufferSize);
-        p->in_bass_r_raw = fftw_alloc_real(p->FFTbassbufferSize);
-        p->out_bass_r = fftw_alloc_complex(p->FFTbassbufferSize / 2 + 1);
-        p->p_bass_r =
-            fftw_plan_dft_r2c_1d(p->FFTbassbufferSize, p->in_bass_r, p->out_bass_r, fftw_flag);
-
-        // MID + TREBLE
-        p->in_r = fftw_alloc_real(p->FFTbufferSize);
-        p->in_r_raw = fftw_alloc_real(p->FFTbufferSize);
-        p->out_r = fftw_alloc_complex(p->FFTbufferSize / 2 + 1);
-
-        p->p_r = fftw_plan_dft_r2c_1d(p->FFTbufferSize, p->in_r, p->out_r, fftw_flag);
-
-        memset(p->in_bass_r, 0, sizeof(double) * p->FFTbassbufferSize);
-        memset(p->in_r, 0, sizeof(double) * p->FFTbufferSize);
-        memset(p->in_bass_r_raw, 0, sizeof(double) * p->FFTbassbufferSize);
-        memset(p->in_r_raw, 0, sizeof(double) * p->FFTbufferSize);
-        memset(p->out_bass_r, 0, (p->FFTbassbufferSize / 2 + 1) * sizeof(fftw_complex));
-        memset(p->out_r, 0, (p->FFTbufferSize / 2 + 1) * sizeof(fftw_complex));
-    }
+    p->cava_fall = (cava_real *)malloc(number_of_bars * channels * sizeof(cava_real));
+    p->cava_mem = (cava_real *)malloc(number_of_bars * channels * sizeof(cava_real));
+    p->cava_peak = (cava_real *)malloc(number_of_bars * channels * sizeof(cava_real));
+    p->prev_cava_out = (cava_real *)malloc(number_of_bars * channels * sizeof(cava_real));
 
-    memset(p->input_buffer, 0, sizeof(double) * p->input_buffer_size);
 
-    memset(p->cava_fall, 0, sizeof(int) * number_of_bars * channels);
-    memset(p->cava_mem, 0, sizeof(double) * number_of_bars * channels);
-    memset(p->cava_peak, 0, sizeof(double) * number_of_bars * channels);
-    memset(p->prev_cava_out, 0, sizeof(double) * number_of_bars * channels);
+    memset(p->cava_fall, 0, sizeof(cava_real) * number_of_bars * channels);
+    memset(p->cava_mem, 0, sizeof(cava_real) * number_of_bars * channels);
+    memset(p->cava_peak, 0, sizeof(cava_real) * number_of_bars * channels);
+    memset(p->prev_cava_out, 0, sizeof(cava_real) * number_of_bars * channels);
 
     // process: calculate cutoff frequencies and eq
     int lower_cut_off = low_cut_off;
@@ -294,10 +441,169 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
         p->eq[n] /= p->FFTbuffer_upper_cut_off[n] - p->FFTbuffer_lower_cut_off[n] + 1;
     }
     free(relative_cut_off);
+
+    // the highest bin any bass bar sums up decides how far the bass signal can be decimated
+    double bass_top_frequency = 0;
+    for (int n = 0; n < p->bass_cut_off_bar; n++) {
+        double top = (double)(p->FFTbuffer_upper_cut_off[n] + 1) * p->rate / p->FFTbassbufferSize;
+        if (top > bass_top_frequency)
+            bass_top_frequency = top;
+    }
+    p->bass_decimation = 1;
+    while (p->bass_decimation < MAX_BASS_DECIMATION &&
+           DECIMATION_PASSBAND * p->rate / (p->bass_decimation * 2) >= bass_top_frequency)
+        p->bass_decimation *= 2;
+    p->FFTbassdecimatedSize = p->FFTbassbufferSize / p->bass_decimation;
+    init_decimation(p);
+
+    // Hann Window calculate multipliers
+    // the decimated bass transform sums bass_decimation times fewer samples, the window gain
+    // brings its magnitudes back to those of the full rate transform the eq was made for
+    p->bass_multiplier = (cava_real *)malloc(p->FFTbassdecimatedSize * sizeof(cava_real));
+    p->multiplier = (cava_real *)malloc(p->FFTbufferSize * sizeof(cava_real));
+    for (int i = 0; i < p->FFTbassdecimatedSize; i++) {
+        p->bass_multiplier[i] = p->bass_decimation * 0.5 *
+                                (1 - cos(2 * M_PI * i / (p->FFTbassdecimatedSize - 1)));
+    }
+    for (int i = 0; i < p->FFTbufferSize; i++) {
+        p->multiplier[i] = 0.5 * (1 - cos(2 * M_PI * i / (p->FFTbufferSize - 1)));
+    }
+
+    // every channel lives in one buffer per stage, channel after channel, so a single batched plan
+    // per band transforms them all and the magnitude and band loops cover them in one pass
+    int bass_bins = p->FFTbassdecimatedSize / 2 + 1;
+    int treble_bins = p->FFTbufferSize / 2 + 1;
+
+    p->bass_magnitude_bins = 0;
+    p->treble_magnitude_bins = 0;
+    for (int n = 0; n < p->number_of_bars; n++) {
+        int *bins = n < p->bass_cut_off_bar ? &p->bass_magnitude_bins : &p->treble_magnitude_bins;
+        if (p->FFTbuffer_upper_cut_off[n] + 1 > *bins)
+            *bins = p->FFTbuffer_upper_cut_off[n] + 1;
+    }
+    if (p->bass_magnitude_bins > bass_bins)
+        p->bass_magnitude_bins = bass_bins;
+    if (p->treble_magnitude_bins > treble_bins)
+        p->treble_magnitude_bins = treble_bins;
+
+    // BASS
+    p->in_bass_l = CAVA_FFTW(alloc_real)(p->FFTbassdecimatedSize * channels);
+    p->out_bass_l = CAVA_FFTW(alloc_complex)(bass_bins * channels);
+    p->p_bass = plan_r2c(p->FFTbassdecimatedSize, channels, p->in_bass_l, p->out_bass_l,
+                         fftw_flag, use_wisdom, &wisdom_missed);
+
+    // MID + TREBLE
+    p->in_l = CAVA_FFTW(alloc_real)(p->FFTbufferSize * channels);
+    p->out_l = CAVA_FFTW(alloc_complex)(treble_bins * channels);
+    p->p_treble = plan_r2c(p->FFTbufferSize, channels, p->in_l, p->out_l, fftw_flag, use_wisdom,
+                           &wisdom_missed);
+
+    memset(p->in_bass_l, 0, sizeof(cava_real) * p->FFTbassdecimatedSize * channels);
+    memset(p->in_l, 0, sizeof(cava_real) * p->FFTbufferSize * channels);
+    memset(p->out_bass_l, 0, bass_bins * channels * sizeof(cava_complex));
+    memset(p->out_l, 0, treble_bins * channels * sizeof(cava_complex));
+
+    p->mag_bass_l = CAVA_FFTW(alloc_real)(bass_bins * channels);
+    p->mag_l = CAVA_FFTW(alloc_real)(treble_bins * channels);
+    memset(p->mag_bass_l, 0, bass_bins * channels * sizeof(cava_real));
+    memset(p->mag_l, 0, treble_bins * channels * sizeof(cava_real));
+
+    p->in_bass_r = p->in_r = NULL;
+    p->out_bass_r = p->out_r = NULL;
+    p->mag_bass_r = p->mag_r = NULL;
+    if (channels == 2) {
+        p->in_bass_r = p->in_bass_l + p->FFTbassdecimatedSize;
+        p->in_r = p->in_l + p->FFTbufferSize;
+        p->out_bass_r = p->out_bass_l + bass_bins;
+        p->out_r = p->out_l + treble_bins;
+        p->mag_bass_r = p->mag_bass_l + bass_bins;
+        p->mag_r = p->mag_l + treble_bins;
+    }
+
+    if (wisdom_missed)
+        export_wisdom(wisdom_path);
     return p;
 }
 
-void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cava_plan *p) {
+// the kernels below are written as plain restrict qualified loops without branches or calls so
+// the compiler turns them into SSE/AVX code. keep them that way.
+
+// appends frames to the mirrored history of one channel, reading every `stride`th sample
+static void push_history(cava_real *restrict history, int size, int cursor,
+                         const cava_real *restrict in, int stride, int frames) {
+    for (int n = 0; n < frames; n++) {
+        cava_real sample = in[n * stride];
+        history[cursor] = sample;
+        history[cursor + size] = sample;
+        if (++cursor == size)
+            cursor = 0;
+    }
+}
+
+static cava_real fir(const cava_real *restrict taps, const cava_real *restrict samples, int size) {
+    cava_real sum = 0;
+    for (int i = 0; i < size; i++) {
+        sum += taps[i] * samples[i];
+    }
+    return sum;
+}
+
+// low pass filters the frames just appended to a full rate history, starting at cursor, and
+// appends every bass_decimation'th of them to the mirrored decimated history. the mirror keeps
+// the decimation_taps frames up to any frame contiguous, so each output is one dot product
+static void push_decimated(const struct cava_plan *p, const cava_real *history, int cursor,
+                           int frames, cava_real *bass_history) {
+    int bass_cursor = p->bass_history_cursor;
+    for (int n = p->bass_decimation - 1 - p->decimation_phase; n < frames;
+         n += p->bass_decimation) {
+        int newest = (cursor + n) % p->FFTbassbufferSize + p->FFTbassbufferSize;
+        const cava_real *window = history + newest - p->decimation_taps + 1;
+        cava_real sample = fir(p->decimation_filter, window, p->decimation_taps);
+        bass_history[bass_cursor] = sample;
+        bass_history[bass_cursor + p->FFTbassdecimatedSize] = sample;
+        if (++bass_cursor == p->FFTbassdecimatedSize)
+            bass_cursor = 0;
+    }
+}
+
+static void apply_window(const cava_real *restrict window, const cava_real *restrict raw,
+                         cava_real *restrict out, int size) {
+    for (int i = 0; i < size; i++) {
+        out[i] = window[i] * raw[i];
+    }
+}
+
+// |X| per bin from the squared magnitude; sqrt vectorizes where hypot does not, and the
+// overflow protection hypot pays for is pointless at audio levels
+static void magnitudes(const cava_complex *restrict bins, cava_real *restrict mag, int size) {
+    for (int i = 0; i < size; i++) {
+        cava_real re = bins[i][0];
+        cava_real im = bins[i][1];
+        mag[i] = CAVA_SQRT(re * re + im * im);
+    }
+}
+
+static cava_real band_sum(const cava_real *restrict mag, int lower, int upper) {
+    cava_real sum = 0;
+    for (int i = lower; i <= upper; i++) {
+        sum += mag[i];
+    }
+    return sum;
+}
+
+// both channels' sums in one pass over the band
+static void band_sum_stereo(const cava_real *restrict mag_l, const cava_real *restrict mag_r,
+                            int lower, int upper, cava_real *sum_l, cava_real *sum_r) {
+    cava_real l = 0, r = 0;
+    for (int i = lower; i <= upper; i++) {
+        l += mag_l[i];
+        r += mag_r[i];
+    }
+    *sum_l = l;
+    *sum_r = r;
+}
+
+void cava_execute(cava_real *cava_in, int new_samples, cava_real *cava_out, struct cava_plan *p) {
 
     // do not overflow
     if (new_samples > p->input_buffer_size) {
@@ -309,81 +615,83 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
         p->framerate -= p->framerate / 64;
         p->framerate += (double)((p->rate * p->audio_channels * p->frame_skip) / new_samples) / 64;
         p->frame_skip = 1;
-        // shifting input buffer
-        for (uint16_t n = p->input_buffer_size - 1; n >= new_samples; n--) {
-            p->input_buffer[n] = p->input_buffer[n - new_samples];
-        }
 
-        // fill the input buffer
-        for (uint16_t n = 0; n < new_samples; n++) {
-            p->input_buffer[new_samples - n - 1] = cava_in[n];
+        for (int n = 0; n < new_samples; n++) {
             if (cava_in[n]) {
                 silence = 0;
+                break;
             }
         }
-    } else {
-        p->frame_skip++;
-    }
 
-    // fill the bass, mid and treble buffers
-    for (uint16_t n = 0; n < p->FFTbassbufferSize; n++) {
-        if (p->audio_channels == 2) {
-            p->in_bass_r_raw[n] = p->input_buffer[n * 2];
-            p->in_bass_l_raw[n] = p->input_buffer[n * 2 + 1];
-        } else {
-            p->in_bass_l_raw[n] = p->input_buffer[n];
+        // append to the history ring, frames older than the history would be overwritten anyway
+        int frames = new_samples / p->audio_channels;
+        const cava_real *first = cava_in;
+        if (frames > p->FFTbassbufferSize) {
+            first += (frames - p->FFTbassbufferSize) * p->audio_channels;
+            frames = p->FFTbassbufferSize;
         }
-    }
-    for (uint16_t n = 0; n < p->FFTbufferSize; n++) {
+        push_history(p->history_l, p->FFTbassbufferSize, p->history_cursor, first,
+                     p->audio_channels, frames);
+        push_decimated(p, p->history_l, p->history_cursor, frames, p->bass_history_l);
         if (p->audio_channels == 2) {
-            p->in_r_raw[n] = p->input_buffer[n * 2];
-            p->in_l_raw[n] = p->input_buffer[n * 2 + 1];
-        } else {
-            p->in_l_raw[n] = p->input_buffer[n];
+            push_history(p->history_r, p->FFTbassbufferSize, p->history_cursor, first + 1, 2,
+                         frames);
+            push_decimated(p, p->history_r, p->history_cursor, frames, p->bass_history_r);
         }
-    }
+        p->history_cursor = (p->history_cursor + frames) % p->FFTbassbufferSize;
 
-    // Hann Window
-    for (int i = 0; i < p->FFTbassbufferSize; i++) {
-        p->in_bass_l[i] = p->bass_multiplier[i] * p->in_bass_l_raw[i];
-        if (p->audio_channels == 2)
-            p->in_bass_r[i] = p->bass_multiplier[i] * p->in_bass_r_raw[i];
+        int decimated = (p->decimation_phase + frames) / p->bass_decimation;
+        p->decimation_phase = (p->decimation_phase + frames) % p->bass_decimation;
+        p->bass_history_cursor = (p->bass_history_cursor + decimated) % p->FFTbassdecimatedSize;
+    } else {
+        p->frame_skip++;
     }
-    for (int i = 0; i < p->FFTbufferSize; i++) {
-        p->in_l[i] = p->multiplier[i] * p->in_l_raw[i];
-        if (p->audio_channels == 2)
-            p->in_r[i] = p->multiplier[i] * p->in_r_raw[i];
+
+    // Hann Window, straight out of the history. the newest frames are read oldest first, which
+    // is the time reversal of what the window used to see; the window is symmetric and
+    // reversing a real signal only conjugates its spectrum, so the magnitudes are the same
+    const cava_real *bass_l = p->bass_history_l + p->bass_history_cursor;
+    const cava_real *treble_l =
+        p->history_l + p->history_cursor + p->FFTbassbufferSize - p->FFTbufferSize;
+    apply_window(p->bass_multiplier, bass_l, p->in_bass_l, p->FFTbassdecimatedSize);
+    apply_window(p->multiplier, treble_l, p->in_l, p->FFTbufferSize);
+    if (p->audio_channels == 2) {
+        const cava_real *bass_r = p->bass_history_r + p->bass_history_cursor;
+        const cava_real *treble_r =
+            p->history_r + p->history_cursor + p->FFTbassbufferSize - p->FFTbufferSize;
+        apply_window(p->bass_multiplier, bass_r, p->in_bass_r, p->FFTbassdecimatedSize);
+        apply_window(p->multiplier, treble_r, p->in_r, p->FFTbufferSize);
     }
 
     // process: execute FFT and sort frequency bands
 
-    fftw_execute(p->p_bass_l);
-    fftw_execute(p->p_l);
+    CAVA_FFTW(execute)(p->p_bass);
+    CAVA_FFTW(execute)(p->p_treble);
+    magnitudes(p->out_bass_l, p->mag_bass_l, p->bass_magnitude_bins);
+    magnitudes(p->out_l, p->mag_l, p->treble_magnitude_bins);
     if (p->audio_channels == 2) {
-        fftw_execute(p->p_bass_r);
-        fftw_execute(p->p_r);
+        magnitudes(p->out_bass_r, p->mag_bass_r, p->bass_magnitude_bins);
+        magnitudes(p->out_r, p->mag_r, p->treble_magnitude_bins);
     }
 
     // process: separate frequency bands
     for (int n = 0; n < p->number_of_bars; n++) {
 
-        double temp_l = 0;
-        double temp_r = 0;
+        cava_real temp_l = 0;
+        cava_real temp_r = 0;
 
         // process: add upp FFT values within bands
-        for (int i = p->FFTbuffer_lower_cut_off[n]; i <= p->FFTbuffer_upper_cut_off[n]; i++) {
-
-            if (n < p->bass_cut_off_bar) {
-                temp_l += hypot(p->out_bass_l[i][0], p->out_bass_l[i][1]);
-                if (p->audio_channels == 2)
-                    temp_r += hypot(p->out_bass_r[i][0], p->out_bass_r[i][1]);
-
-            } else {
-                temp_l += hypot(p->out_l[i][0], p->out_l[i][1]);
-                if (p->audio_channels == 2)
-                    temp_r += hypot(p->out_r[i][0], p->out_r[i][1]);
-            }
+        int lower = p->FFTbuffer_lower_cut_off[n];
+        int upper = p->FFTbuffer_upper_cut_off[n];
+        const cava_real *mag_l = p->mag_l, *mag_r = p->mag_r;
+        if (n < p->bass_cut_off_bar) {
+            mag_l = p->mag_bass_l;
+            mag_r = p->mag_bass_r;
         }
+        if (p->audio_channels == 2)
+            band_sum_stereo(mag_l, mag_r, lower, upper, &temp_l, &temp_r);
+        else
+            temp_l = band_sum(mag_l, lower, upper);
 
         // getting average multiply with eq
         temp_l *= p->eq[n];
@@ -452,9 +760,59 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
     }
 }
 
+// resamples one channel's per bar smoothing state onto a different bar count, nearest bar by position
+static void resample_bars(cava_real *to, int to_bars, const cava_real *from, int from_bars) {
+    for (int n = 0; n < to_bars; n++)
+        to[n] = from[(int)((long)n * from_bars / to_bars)];
+}
+
+void cava_carry_state(struct cava_plan *to, const struct cava_plan *from) {
+    to->sens = from->sens;
+    to->sens_init = from->sens_init;
+    to->framerate = from->framerate;
+    to->frame_skip = from->frame_skip;
+
+    // the sample history only depends on the rate and the fft sizes, which the bar layout and the
+    // cut off frequencies rarely change. if they did, the history refills within one bass window
+    if (to->audio_channels == from->audio_channels &&
+        to->FFTbassbufferSize == from->FFTbassbufferSize &&
+        to->bass_decimation == from->bass_decimation &&
+        to->FFTbassdecimatedSize == from->FFTbassdecimatedSize) {
+        size_t history = (size_t)to->FFTbassbufferSize * 2 * sizeof(cava_real);
+        size_t bass_history = (size_t)to->FFTbassdecimatedSize * 2 * sizeof(cava_real);
+        memcpy(to->history_l, from->history_l, history);
+        memcpy(to->bass_history_l, from->bass_history_l, bass_history);
+        if (to->audio_channels == 2) {
+            memcpy(to->history_r, from->history_r, history);
+            memcpy(to->bass_history_r, from->bass_history_r, bass_history);
+        }
+        to->history_cursor = from->history_cursor;
+        to->bass_history_cursor = from->bass_history_cursor;
+        to->decimation_phase = from->decimation_phase;
+    }
+
+    if (to->audio_channels != from->audio_channels)
+        return;
+    for (int c = 0; c < to->audio_channels; c++) {
+        int t = c * to->number_of_bars, f = c * from->number_of_bars;
+        resample_bars(to->prev_cava_out + t, to->number_of_bars, from->prev_cava_out + f,
+                      from->number_of_bars);
+        resample_bars(to->cava_mem + t, to->number_of_bars, from->cava_mem + f,
+                      from->number_of_bars);
+        resample_bars(to->cava_peak + t, to->number_of_bars, from->cava_peak + f,
+                      from->number_of_bars);
+        resample_bars(to->cava_fall + t, to->number_of_bars, from->cava_fall + f,
+                      from->number_of_bars);
+    }
+}
+
 void cava_destroy(struct cava_plan *p) {
 
-    free(p->input_buffer);
+    free(p->history_l);
+    free(p->history_r);
+    free(p->bass_history_l);
+    free(p->bass_history_r);
+    free(p->decimation_filter);
     free(p->bass_multiplier);
     free(p->multiplier);
     free(p->eq);
@@ -466,30 +824,41 @@ void cava_destroy(struct cava_plan *p) {
     free(p->cava_peak);
     free(p->prev_cava_out);
 
-    fftw_free(p->in_bass_l);
-    fftw_free(p->in_bass_l_raw);
-    fftw_free(p->out_bass_l);
-    fftw_destroy_plan(p->p_bass_l);
+    // the right channel buffers are part of the left ones
+    CAVA_FFTW(free)(p->in_bass_l);
+    CAVA_FFTW(free)(p->out_bass_l);
+    CAVA_FFTW(destroy_plan)(p->p_bass);
 
-    fftw_free(p->in_l);
-    fftw_free(p->in_l_raw);
-    fftw_free(p->out_l);
-    fftw_destroy_plan(p->p_l);
+    CAVA_FFTW(free)(p->mag_bass_l);
+    CAVA_FFTW(free)(p->mag_l);
 
-    if (p->audio_channels == 2) {
-        fftw_free(p->in_bass_r);
-        fftw_free(p->in_bass_r_raw);
-        fftw_free(p->out_bass_r);
-        fftw_destroy_plan(p->p_bass_r);
-
-        fftw_free(p->in_r);
-        fftw_free(p->out_r);
-        fftw_free(p->in_r_raw);
-        fftw_destroy_plan(p->p_r);
-    }
+    CAVA_FFTW(free)(p->in_l);
+    CAVA_FFTW(free)(p->out_l);
+    CAVA_FFTW(destroy_plan)(p->p_treble);
 }
 
 #ifdef __ANDROID__
+// java hands over and expects doubles, cava_real may be float: convert through cava_in and cava_out
+static jdoubleArray exec_cava_doubles(JNIEnv *env, jdoubleArray cava_input, jint new_samples) {
+    jdoubleArray cavaReturn = (*env)->NewDoubleArray(env, plan->number_of_bars);
+
+    if (new_samples > plan->input_buffer_size)
+        new_samples = plan->input_buffer_size;
+    jdouble *input = (*env)->GetDoubleArrayElements(env, cava_input, NULL);
+    for (int n = 0; n < new_samples; n++)
+        cava_in[n] = (cava_real)input[n];
+    (*env)->ReleaseDoubleArrayElements(env, cava_input, input, JNI_ABORT);
+
+    cava_execute(cava_in, new_samples, cava_out, plan);
+
+    jdouble *output = (*env)->GetDoubleArrayElements(env, cavaReturn, NULL);
+    for (int n = 0; n < plan->number_of_bars; n++)
+        output[n] = cava_out[n];
+    (*env)->ReleaseDoubleArrayElements(env, cavaReturn, output, 0);
+
+    return cavaReturn;
+}
+
 JNIEXPORT jfloatArray JNICALL Java_com_karlstav_cava_MyGLRenderer_InitCava(
     JNIEnv *env, jobject thiz, jint number_of_bars_set, jint refresh_rate, jint lower_cut_off,
     jint higher_cut_off) {
@@ -498,8 +867,8 @@ JNIEXPORT jfloatArray JNICALL Java_com_karlstav_cava_MyGLRenderer_InitCava(
 
     plan =
         cava_init(number_of_bars_set, 44100, 1, 1, noise_reduction, lower_cut_off, higher_cut_off);
-    cava_in = (double *)malloc(plan->FFTbassbufferSize * sizeof(double));
-    cava_out = (double *)malloc(plan->number_of_bars * sizeof(double));
+    cava_in = (cava_real *)malloc(plan->input_buffer_size * sizeof(cava_real));
+    cava_out = (cava_real *)malloc(plan->number_of_bars * sizeof(cava_real));
     (*env)->SetFloatArrayRegion(env, cuttOffFreq, 0, plan->number_of_bars + 1,
                                 plan->cut_off_frequency);
     return cuttOffFreq;
@@ -510,21 +879,15 @@ JNIEXPORT jdoubleArray JNICALL Java_com_karlstav_cava_MyGLRenderer_ExecCava(JNIE
                                                                             jdoubleArray cava_input,
                                                                             jint new_samples) {
 
-    jdoubleArray cavaReturn = (*env)->NewDoubleArray(env, plan->number_of_bars);
-
-    cava_in = (*env)->GetDoubleArrayElements(env, cava_input, NULL);
-
-    cava_execute(cava_in, new_samples, cava_out, plan);
-    (*env)->SetDoubleArrayRegion(env, cavaReturn, 0, plan->number_of_bars, cava_out);
-    (*env)->ReleaseDoubleArrayElements(env, cava_input, cava_in, JNI_ABORT);
-
-    return cavaReturn;
+    return exec_cava_doubles(env, cava_input, new_samples);
 }
 
 JNIEXPORT int JNICALL Java_com_karlstav_cava_CavaCoreTest_InitCava(JNIEnv *env, jobject thiz,
                                                                    jint number_of_bars_set) {
 
     plan = cava_init(number_of_bars_set, 44100, 1, 1, 0.7, 50, 10000);
+    cava_in = (cava_real *)malloc(plan->input_buffer_size * sizeof(cava_real));
+    cava_out = (cava_real *)malloc(plan->number_of_bars * sizeof(cava_real));
     return 1;
 }
 
@@ -533,15 +896,7 @@ JNIEXPORT jdoubleArray JNICALL Java_com_karlstav_cava_CavaCoreTest_ExecCava(JNIE
                                                                             jdoubleArray cava_input,
                                                                             jint new_samples) {
 
-    jdoubleArray cavaReturn = (*env)->NewDoubleArray(env, plan->number_of_bars);
-
-    cava_in = (*env)->GetDoubleArrayElements(env, cava_input, NULL);
-
-    cava_execute(cava_in, new_samples, cava_out, plan);
-    (*env)->SetDoubleArrayRegion(env, cavaReturn, 0, plan->number_of_bars, cava_out);
-    (*env)->ReleaseDoubleArrayElements(env, cava_input, cava_in, JNI_ABORT);
-
-    return cavaReturn;
+    return exec_cava_doubles(env, cava_input, new_samples);
 }
 JNIEXPORT void JNICALL Java_com_karlstav_cava_MyGLRenderer_DestroyCava(JNIEnv *env, jobject thiz) {
     cava_destroy(plan);
@@ -23,10 +23,24 @@ SOFTWARE.
 extern "C" {
 #endif
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
 #include <fftw3.h>
 
+// CAVA_SINGLE_PRECISION builds the whole pipeline in float on top of fftwf. That halves the memory
+// traffic of the window/FFT/band loops and doubles the SIMD lane count; results match the double
+// build to within float rounding.
+#ifdef CAVA_SINGLE_PRECISION
+typedef float cava_real;
+typedef fftwf_complex cava_complex;
+typedef fftwf_plan cava_fft_plan;
+#else
+typedef double cava_real;
+typedef fftw_complex cava_complex;
+typedef fftw_plan cava_fft_plan;
+#endif
+
 // cava_plan, parameters used internally by cavacore, do not modify these directly
 // only the cut off frequencies is of any potential interest to read out,
 // the rest should most likley be hidden somehow
@@ -48,28 +62,52 @@ struct cava_plan {
     double framerate;
     double noise_reduction;
 
-    fftw_plan p_bass_l, p_bass_r;
-    fftw_plan p_l, p_r;
-
-    fftw_complex *out_bass_l, *out_bass_r;
-    fftw_complex *out_l, *out_r;
-
-    double *bass_multiplier;
-    double *multiplier;
-
-    double *in_bass_r_raw, *in_bass_l_raw;
-    double *in_r_raw, *in_l_raw;
-    double *in_bass_r, *in_bass_l;
-    double *in_r, *in_l;
-    double *prev_cava_out, *cava_mem;
-    double *input_buffer, *cava_peak;
-
-    double *eq;
+    // one batched plan per band transforms every channel. the channels' inputs, outputs and
+    // magnitudes sit back to back in the _l buffers, the _r pointers point at the second half
+    cava_fft_plan p_bass, p_treble;
+
+    cava_complex *out_bass_l, *out_bass_r;
+    cava_complex *out_l, *out_r;
+
+    // per bin magnitudes of the FFT outputs, filled by a branch free kernel before band summing
+    cava_real *mag_bass_l, *mag_bass_r;
+    cava_real *mag_l, *mag_r;
+    // bins per channel the bars read, one past the highest upper cut off of each band. the rest
+    // of the spectrum up to nyquist is never summed, so its magnitudes are not taken
+    int bass_magnitude_bins, treble_magnitude_bins;
+
+    cava_real *bass_multiplier;
+    cava_real *multiplier;
+
+    // per channel sample history, FFTbassbufferSize frames long. every sample is stored twice,
+    // at cursor and cursor + FFTbassbufferSize, so the newest N frames are always contiguous
+    // and the windowing reads them in place instead of shifting the history every frame
+    cava_real *history_l, *history_r;
+    int history_cursor;
+
+    // multirate bass: the bass bars only read the lowest bins, so the bass fft runs on the signal
+    // low passed and decimated by bass_decimation. same window length and bin spacing as a
+    // FFTbassbufferSize transform at the full rate, in a transform that many times smaller
+    int bass_decimation;
+    int FFTbassdecimatedSize; // FFTbassbufferSize / bass_decimation, the bass transform length
+    int decimation_taps;
+    cava_real *decimation_filter;
+    int decimation_phase; // full rate frames since the last decimated one
+    // decimated history, mirrored like history_l, FFTbassdecimatedSize frames long
+    cava_real *bass_history_l, *bass_history_r;
+    int bass_history_cursor;
+
+    cava_real *in_bass_r, *in_bass_l;
+    cava_real *in_r, *in_l;
+    cava_real *prev_cava_out, *cava_mem;
+    cava_real *cava_peak;
+
+    cava_real *eq;
 
     float *cut_off_frequency;
     int *FFTbuffer_lower_cut_off;
     int *FFTbuffer_upper_cut_off;
-    double *cava_fall;
+    cava_real *cava_fall;
 };
 
 // cava_init, initialize visualization, takes the following parameters:
@@ -101,6 +139,30 @@ extern struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int ch
                                    int autosens, double noise_reduction, int low_cut_off,
                                    int high_cut_off);
 
+// cava_set_wisdom_dir, optional fftw wisdom cache shared by all following cava_init calls
+
+// dir, directory holding the wisdom file, NULL disables the cache (the default). the file holds
+// every fft size planned so far and is keyed by the precision, the fftw version and the cpu, so a
+// cache directory can be shared between machines and builds without ever importing wisdom that
+// does not fit
+
+// planner_flags, rigor used when the cache does not cover a plan yet, FFTW_MEASURE or FFTW_PATIENT.
+// that plan is written back to the cache, every later cava_init with the same sizes plans
+// instantly from the file
+
+// returns nothing, problems with the cache are not fatal, cava_init just plans from scratch
+extern void cava_set_wisdom_dir(const char *dir, unsigned int planner_flags);
+
+// cava_wisdom_path, writes the cache file cava_init uses into path.
+// returns 0 on success, -1 if no cache directory is set or path is too small
+extern int cava_wisdom_path(char *path, size_t size);
+
+// cava_generate_wisdom, plans every transform cava_init can pick at the given sample rate, for
+// mono and stereo and every bass decimation any bar count or cut offs lead to, with the rigor set
+// by cava_set_wisdom_dir, and adds them to the cache file
+// returns 0 on success, -1 if no cache directory is set or a transform could not be planned
+extern int cava_generate_wisdom(unsigned int rate);
+
 // cava_execute, executes visualization
 
 // cava_in, input buffer can be any size. internal buffers in cavacore is
@@ -120,9 +182,18 @@ extern struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int ch
 
 // cava_execute assumes cava_in samples to be interleaved if more than one channel
 // only up to two channels are supported.
-extern void cava_execute(double *cava_in, int new_samples, double *cava_out,
+extern void cava_execute(cava_real *cava_in, int new_samples, cava_real *cava_out,
                          struct cava_plan *plan);
 
+// cava_carry_state, continues the analysis of one plan in another, e.g. when the bars or cut off
+// frequencies change while running. copies the sample history if the fft sizes match and carries
+// the smoothing filters and the sensitivity over, resampled to the new number of bars, so the
+// output keeps moving instead of restarting from zero
+
+// to, the freshly initialized plan that replaces from. both need the same number of channels for
+// the filters to carry over
+extern void cava_carry_state(struct cava_plan *to, const struct cava_plan *from);
+
 // cava_destroy, destroys the plan, frees up memory
 extern void cava_destroy(struct cava_plan *plan);
 
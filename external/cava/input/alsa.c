@@ -48,9 +48,10 @@ static void initialize_audio_parameters(snd_pcm_t **handle, struct audio_data *a
     // converting result to number of bits
     if (sample_rate <= 5)
         audio->format = 16;
-    else if (sample_rate <= 9)
+    else if (sample_rate <= 9) {
         audio->format = 24;
-    else
+        audio->sample_bytes = 4; // S24_LE, 24 bits in a 32 bit container
+    } else
         audio->format = 32;
     snd_pcm_hw_params_get_rate(params, &audio->rate, NULL);
     snd_pcm_hw_params_get_period_size(params, frames, NULL);
@@ -0,0 +1,377 @@
+#include "capture.h"
+#include "common.h"
+
+#include <time.h>
+
+#define CAPTURE_MAGIC "CAVACAP"
+#define CAPTURE_BYTE_ORDER 0x01020304u
+
+// the largest record a reader accepts, guards the payload allocation against a corrupt count
+#define CAPTURE_MAX_PAYLOAD (64u << 20)
+
+// bytes queued per recording thread, power of two. the writer thread drains the queues every
+// CAPTURE_DRAIN_NS, so this is about 2.7 s of the largest stream (192 khz stereo 32 bit) the disk
+// may stall before the recording stops
+#define CAPTURE_QUEUE_BYTES (4u << 20)
+#define CAPTURE_DRAIN_NS 5000000L
+
+// why a recording stopped, the writer thread reports it
+enum capture_stop {
+    CAPTURE_RUNNING,
+    CAPTURE_FORMAT_CHANGED,
+    CAPTURE_OVERFLOW,
+    CAPTURE_WRITE_FAILED,
+};
+
+struct capture_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t rate;
+    uint32_t channels;
+    int32_t format;
+    int32_t sample_bytes;
+    int32_t IEEE_FLOAT;
+    int32_t num_bars;
+    int32_t frames_per_step;
+};
+
+struct capture_record {
+    uint32_t type;
+    uint32_t count;
+    uint64_t time_ns;
+};
+
+// wait-free single-producer/single-consumer byte ring between one recording thread and the writer
+// thread, laid out like cava_ring: free running head and tail, a record header and its payload
+// per record, wrapping around the end of the buffer
+struct capture_queue {
+    unsigned char *buffer;
+    _Atomic size_t head; // only advanced by the recording thread
+    _Atomic size_t tail; // only advanced by the writer thread
+};
+
+struct cava_capture {
+    FILE *file;
+    struct capture_header header;
+    long first_record;
+
+    // writer. the recording threads only queue records, the writer thread owns the file, so
+    // recording never blocks the audio thread on the disk or on the analysis thread
+    int writing;
+    pthread_t thread;
+    struct capture_queue audio, bars;
+    uint64_t start_ns;
+    _Atomic int stopped; // enum capture_stop, the first reason wins
+    _Atomic int closing;
+    int bars_stopped; // only touched by the thread recording bars
+
+    // reader
+    unsigned char *payload;
+    size_t payload_size;
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void stop_recording(struct cava_capture *capture, enum capture_stop reason) {
+    int running = CAPTURE_RUNNING;
+    atomic_compare_exchange_strong(&capture->stopped, &running, reason);
+}
+
+// copies `bytes` from the queue at counter `at` into `out`, in at most two runs
+static void queue_read(const struct capture_queue *queue, size_t at, void *out, size_t bytes) {
+    size_t start = at & (CAPTURE_QUEUE_BYTES - 1);
+    size_t first = CAPTURE_QUEUE_BYTES - start;
+    if (first > bytes)
+        first = bytes;
+    memcpy(out, queue->buffer + start, first);
+    memcpy((unsigned char *)out + first, queue->buffer, bytes - first);
+}
+
+static void queue_write(struct capture_queue *queue, size_t at, const void *in, size_t bytes) {
+    size_t start = at & (CAPTURE_QUEUE_BYTES - 1);
+    size_t first = CAPTURE_QUEUE_BYTES - start;
+    if (first > bytes)
+        first = bytes;
+    memcpy(queue->buffer + start, in, first);
+    memcpy(queue->buffer, (const unsigned char *)in + first, bytes - first);
+}
+
+// recording thread side: never blocks, a record that does not fit stops the recording instead
+static void queue_record(struct cava_capture *capture, struct capture_queue *queue, int type,
+                         uint32_t count, const void *payload, size_t bytes) {
+    struct capture_record record = {
+        .type = type, .count = count, .time_ns = monotonic_ns() - capture->start_ns};
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (sizeof(record) + bytes > CAPTURE_QUEUE_BYTES - (head - tail)) {
+        stop_recording(capture, CAPTURE_OVERFLOW);
+        return;
+    }
+    queue_write(queue, head, &record, sizeof(record));
+    queue_write(queue, head + sizeof(record), payload, bytes);
+    atomic_store_explicit(&queue->head, head + sizeof(record) + bytes, memory_order_release);
+}
+
+static size_t header_sample_bytes(const struct capture_header *header) {
+    return header->sample_bytes > 0 ? (size_t)header->sample_bytes : (size_t)header->format / 8;
+}
+
+static int audio_sample_bytes(const struct audio_data *audio) {
+    return audio->sample_bytes > 0 ? audio->sample_bytes : audio->format / 8;
+}
+
+// payload size of a record, 0 for an unknown type
+static size_t record_bytes(const struct capture_header *header,
+                           const struct capture_record *record) {
+    if (record->type == CAVA_CAPTURE_AUDIO)
+        return (size_t)record->count * header_sample_bytes(header);
+    if (record->type == CAVA_CAPTURE_BARS)
+        return (size_t)record->count * sizeof(float);
+    return 0;
+}
+
+// writes the next queued record of whichever queue holds the older one. returns 0 once both are
+// empty. after a failed write the queues are still drained, their records are dropped
+static int write_next(struct cava_capture *capture) {
+    struct capture_queue *queues[2] = {&capture->audio, &capture->bars};
+    struct capture_queue *queue = NULL;
+    struct capture_record record;
+    size_t tail = 0;
+    for (int i = 0; i < 2; i++) {
+        size_t queue_tail = atomic_load_explicit(&queues[i]->tail, memory_order_relaxed);
+        if (atomic_load_explicit(&queues[i]->head, memory_order_acquire) == queue_tail)
+            continue;
+        struct capture_record next;
+        queue_read(queues[i], queue_tail, &next, sizeof(next));
+        if (queue == NULL || next.time_ns < record.time_ns) {
+            queue = queues[i];
+            record = next;
+            tail = queue_tail;
+        }
+    }
+    if (queue == NULL)
+        return 0;
+
+    size_t bytes = record_bytes(&capture->header, &record);
+    if (atomic_load_explicit(&capture->stopped, memory_order_relaxed) != CAPTURE_WRITE_FAILED) {
+        size_t start = (tail + sizeof(record)) & (CAPTURE_QUEUE_BYTES - 1);
+        size_t first = CAPTURE_QUEUE_BYTES - start;
+        if (first > bytes)
+            first = bytes;
+        if (fwrite(&record, sizeof(record), 1, capture->file) != 1 ||
+            fwrite(queue->buffer + start, 1, first, capture->file) != first ||
+            fwrite(queue->buffer, 1, bytes - first, capture->file) != bytes - first) {
+            fprintf(stderr, __FILE__ ": write failed, recording stopped: %s\n", strerror(errno));
+            atomic_store(&capture->stopped, CAPTURE_WRITE_FAILED);
+        }
+    }
+    atomic_store_explicit(&queue->tail, tail + sizeof(record) + bytes, memory_order_release);
+    return 1;
+}
+
+static void *writer_thread(void *data) {
+    struct cava_capture *capture = data;
+    int reported = CAPTURE_RUNNING;
+    for (;;) {
+        // read before draining, so everything queued before cava_capture_close is written
+        int closing = atomic_load(&capture->closing);
+        while (write_next(capture)) {
+        }
+
+        int stopped = atomic_load(&capture->stopped);
+        if (stopped != reported && stopped != CAPTURE_WRITE_FAILED) {
+            fprintf(stderr, __FILE__ ": %s, recording stopped\n",
+                    stopped == CAPTURE_FORMAT_CHANGED ? "stream format changed"
+                                                      : "the disk fell behind the stream");
+        }
+        reported = stopped;
+
+        if (closing)
+            return NULL;
+        nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = CAPTURE_DRAIN_NS}, NULL);
+    }
+}
+
+struct cava_capture *cava_capture_create(const char *path, const struct audio_data *audio,
+                                         int num_bars, int frames_per_step, char *error,
+                                         size_t error_size) {
+    struct cava_capture *capture = calloc(1, sizeof(*capture));
+    if (capture == NULL) {
+        snprintf(error, error_size, "out of memory");
+        return NULL;
+    }
+
+    capture->file = fopen(path, "wb");
+    if (capture->file == NULL) {
+        snprintf(error, error_size, "could not create %s: %s", path, strerror(errno));
+        free(capture);
+        return NULL;
+    }
+
+    struct capture_header *header = &capture->header;
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header->byte_order = CAPTURE_BYTE_ORDER;
+    header->version = CAVA_CAPTURE_VERSION;
+    header->rate = audio->rate;
+    header->channels = audio->channels;
+    header->format = audio->format;
+    header->sample_bytes = audio_sample_bytes(audio);
+    header->IEEE_FLOAT = audio->IEEE_FLOAT;
+    header->num_bars = num_bars;
+    header->frames_per_step = frames_per_step;
+    if (fwrite(header, sizeof(*header), 1, capture->file) != 1) {
+        snprintf(error, error_size, "could not write %s: %s", path, strerror(errno));
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+    capture->first_record = sizeof(*header);
+
+    capture->audio.buffer = malloc(CAPTURE_QUEUE_BYTES);
+    capture->bars.buffer = malloc(CAPTURE_QUEUE_BYTES);
+    capture->start_ns = monotonic_ns();
+    if (capture->audio.buffer == NULL || capture->bars.buffer == NULL ||
+        pthread_create(&capture->thread, NULL, writer_thread, capture) != 0) {
+        snprintf(error, error_size, "could not start writing %s", path);
+        free(capture->audio.buffer);
+        free(capture->bars.buffer);
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+    capture->writing = 1;
+    return capture;
+}
+
+struct cava_capture *cava_capture_open(const char *path, struct cava_capture_info *info,
+                                       char *error, size_t error_size) {
+    struct cava_capture *capture = calloc(1, sizeof(*capture));
+    if (capture == NULL) {
+        snprintf(error, error_size, "out of memory");
+        return NULL;
+    }
+
+    capture->file = fopen(path, "rb");
+    if (capture->file == NULL) {
+        snprintf(error, error_size, "could not open %s: %s", path, strerror(errno));
+        free(capture);
+        return NULL;
+    }
+
+    struct capture_header *header = &capture->header;
+    const char *problem = NULL;
+    if (fread(header, sizeof(*header), 1, capture->file) != 1 ||
+        memcmp(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+        problem = "not a capture file";
+    else if (header->byte_order != CAPTURE_BYTE_ORDER)
+        problem = "captured on a host with the other byte order";
+    else if (header->version != CAVA_CAPTURE_VERSION)
+        problem = "unsupported capture version";
+    else if (header->rate == 0 || header->channels == 0 || header_sample_bytes(header) == 0 ||
+             header->num_bars < 0 || header->frames_per_step < 0)
+        problem = "invalid stream format";
+    if (problem != NULL) {
+        snprintf(error, error_size, "%s: %s", path, problem);
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+    capture->first_record = sizeof(*header);
+
+    info->rate = header->rate;
+    info->channels = header->channels;
+    info->format = header->format;
+    info->sample_bytes = header->sample_bytes;
+    info->IEEE_FLOAT = header->IEEE_FLOAT;
+    info->num_bars = header->num_bars;
+    info->frames_per_step = header->frames_per_step;
+    return capture;
+}
+
+int cava_capture_close(struct cava_capture *capture) {
+    if (capture == NULL)
+        return 0;
+    int status = 0;
+    if (capture->writing) {
+        atomic_store(&capture->closing, 1);
+        pthread_join(capture->thread, NULL);
+        status = atomic_load(&capture->stopped) == CAPTURE_RUNNING ? 0 : -1;
+        free(capture->audio.buffer);
+        free(capture->bars.buffer);
+    }
+    if (fclose(capture->file) != 0)
+        status = -1;
+    free(capture->payload);
+    free(capture);
+    return status;
+}
+
+void cava_capture_write_audio(struct cava_capture *capture, const struct audio_data *audio,
+                              int samples, const unsigned char *buf) {
+    if (atomic_load_explicit(&capture->stopped, memory_order_relaxed) != CAPTURE_RUNNING)
+        return;
+    const struct capture_header *header = &capture->header;
+    // a capture has one stream format, a backend that renegotiated ends the recording
+    if (audio->rate != header->rate || audio->channels != header->channels ||
+        audio->format != header->format || audio->IEEE_FLOAT != header->IEEE_FLOAT ||
+        audio_sample_bytes(audio) != header->sample_bytes) {
+        stop_recording(capture, CAPTURE_FORMAT_CHANGED);
+        return;
+    }
+    queue_record(capture, &capture->audio, CAVA_CAPTURE_AUDIO, samples, buf,
+                 samples * header_sample_bytes(header));
+}
+
+void cava_capture_write_bars(struct cava_capture *capture, const float *bars, int num_bars) {
+    if (atomic_load_explicit(&capture->stopped, memory_order_relaxed) != CAPTURE_RUNNING ||
+        capture->bars_stopped || capture->header.num_bars <= 0)
+        return;
+    if (num_bars != capture->header.num_bars) {
+        fprintf(stderr, __FILE__ ": number of bars changed, recording audio only\n");
+        capture->bars_stopped = 1;
+        return;
+    }
+    queue_record(capture, &capture->bars, CAVA_CAPTURE_BARS, num_bars, bars,
+                 num_bars * sizeof(float));
+}
+
+int cava_capture_read(struct cava_capture *capture, struct cava_capture_record *record) {
+    struct capture_record raw;
+    size_t got = fread(&raw, 1, sizeof(raw), capture->file);
+    if (got == 0 && feof(capture->file))
+        return 0;
+    if (got != sizeof(raw))
+        return -1;
+
+    if (raw.type != CAVA_CAPTURE_AUDIO && raw.type != CAVA_CAPTURE_BARS)
+        return -1;
+    size_t bytes = record_bytes(&capture->header, &raw);
+    if (bytes > CAPTURE_MAX_PAYLOAD)
+        return -1;
+
+    if (bytes > capture->payload_size) {
+        unsigned char *payload = realloc(capture->payload, bytes);
+        if (payload == NULL)
+            return -1;
+        capture->payload = payload;
+        capture->payload_size = bytes;
+    }
+    if (fread(capture->payload, 1, bytes, capture->file) != bytes)
+        return -1;
+
+    record->type = raw.type;
+    record->time_ns = raw.time_ns;
+    record->count = raw.count;
+    record->payload = capture->payload;
+    record->payload_bytes = bytes;
+    return 1;
+}
+
+int cava_capture_rewind(struct cava_capture *capture) {
+    return fseek(capture->file, capture->first_record, SEEK_SET);
+}
@@ -0,0 +1,66 @@
+// capture files: raw input blocks and bar frames on a timeline, for deterministic replays
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct audio_data;
+
+// a capture is a fixed header followed by records, each a small record header and its payload:
+//   audio: `count` samples exactly as handed to write_to_cava_input_buffers, in the header's format
+//   bars:  `count` floats, one analysis frame
+// everything is in host byte order, a reader on the other endianness refuses the file
+#define CAVA_CAPTURE_VERSION 2
+
+enum cava_capture_type {
+    CAVA_CAPTURE_AUDIO = 1,
+    CAVA_CAPTURE_BARS = 2,
+};
+
+struct cava_capture_info {
+    unsigned int rate;
+    unsigned int channels;
+    int format;       // bits per sample, like audio_data
+    int sample_bytes; // bytes per sample in the stream, 0 means format / 8
+    int IEEE_FLOAT;
+    int num_bars; // length of a bar frame, 0 if the capture holds audio only
+    // frames of audio per analysis step when every bar frame was computed from a fixed number of
+    // frames (ywp-bench), 0 when the bars follow a live analysis thread's own cadence
+    int frames_per_step;
+};
+
+struct cava_capture_record {
+    int type;             // enum cava_capture_type
+    uint64_t time_ns;     // since the capture was created
+    uint32_t count;       // samples or bars
+    const void *payload;  // valid until the next read
+    size_t payload_bytes;
+};
+
+// creates `path` for writing, taking the stream format from `audio`. pass a non-zero `num_bars` to
+// also record bar frames, and `frames_per_step` (see cava_capture_info) when they are computed in
+// lockstep with the audio. returns NULL with the reason in `error`
+struct cava_capture *cava_capture_create(const char *path, const struct audio_data *audio,
+                                         int num_bars, int frames_per_step, char *error,
+                                         size_t error_size);
+// opens `path` for reading and fills `info` from its header
+struct cava_capture *cava_capture_open(const char *path, struct cava_capture_info *info,
+                                       char *error, size_t error_size);
+// writes out everything still queued. returns -1 if a recording stopped early, 0 otherwise
+int cava_capture_close(struct cava_capture *capture);
+
+// each of these takes records from one thread at a time, usually the input thread and the
+// analysis thread. they never block or touch the file: records go through a lock free queue per
+// thread to a writer thread, so recording is safe on a realtime audio thread. a stream format
+// change, a failed write or a disk that falls too far behind stops the recording with a message
+// on stderr, a frame with another number of bars than the header's only stops the bar frames
+void cava_capture_write_audio(struct cava_capture *capture, const struct audio_data *audio,
+                              int samples, const unsigned char *buf);
+void cava_capture_write_bars(struct cava_capture *capture, const float *bars, int num_bars);
+
+// reads the next record. returns 1 on success, 0 at the end of the capture and -1 if the file is
+// truncated or corrupt
+int cava_capture_read(struct cava_capture *capture, struct cava_capture_record *record);
+// seeks back to the first record
+int cava_capture_rewind(struct cava_capture *capture);
@@ -1,68 +1,256 @@
 #include "common.h"
-#include <limits.h>
+#include "capture.h"
 #include <math.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/eventfd.h>
 
-int write_to_cava_input_buffers(int16_t samples, unsigned char *buf, void *data) {
-    if (samples == 0)
+int init_cava_input_ring(struct cava_ring *ring, size_t capacity) {
+    // round up to a power of two so indexing is a mask instead of a modulo
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    ring->buffer = (cava_real *)calloc(size, sizeof(cava_real));
+    if (ring->buffer == NULL)
+        return -1;
+    ring->capacity = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overruns, 0);
+    atomic_init(&ring->dropped_samples, 0);
+    atomic_init(&ring->consumer_waiting, false);
+    ring->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring->wakeup_fd < 0) {
+        free(ring->buffer);
+        ring->buffer = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void free_cava_input_ring(struct cava_ring *ring) {
+    free(ring->buffer);
+    ring->buffer = NULL;
+    ring->capacity = 0;
+    if (ring->wakeup_fd >= 0)
+        close(ring->wakeup_fd);
+    ring->wakeup_fd = -1;
+}
+
+void wake_cava_input_reader(struct cava_ring *ring) {
+    uint64_t one = 1;
+    if (write(ring->wakeup_fd, &one, sizeof(one)) < 0) {
+        // counter saturated, the reader is awake anyway
+    }
+}
+
+// only notify when the consumer announced it is about to sleep, so the common case stays a
+// plain store. the fence pairs with the one in wait_for_cava_input
+static void publish_head(struct cava_ring *ring, size_t head) {
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->consumer_waiting, memory_order_relaxed))
+        wake_cava_input_reader(ring);
+}
+
+void wait_for_cava_input(struct cava_ring *ring) {
+    atomic_store_explicit(&ring->consumer_waiting, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (head == tail) {
+        struct pollfd pfd = {.fd = ring->wakeup_fd, .events = POLLIN};
+        poll(&pfd, 1, -1);
+    }
+    atomic_store_explicit(&ring->consumer_waiting, false, memory_order_relaxed);
+
+    uint64_t count;
+    if (read(ring->wakeup_fd, &count, sizeof(count)) < 0) {
+        // nothing pending, EAGAIN
+    }
+}
+
+// number of samples the producer may write without overtaking the consumer, kept a multiple of
+// the channel count so a partial write never splits an interleaved frame
+static size_t ring_free_samples(struct cava_ring *ring, size_t head, unsigned int channels) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t available = ring->capacity - (head - tail);
+    if (channels > 1)
+        available -= available % channels;
+    return available;
+}
+
+// conversion kernels, one per stream format. plain restrict loops over memcpy'd loads so the
+// compiler vectorizes them without caring about alignment. everything is scaled to int16 full scale,
+// which is what the analysis was tuned for
+
+static void convert_s8(cava_real *restrict out, const unsigned char *restrict in, size_t samples) {
+    for (size_t i = 0; i < samples; i++)
+        out[i] = (cava_real)(int8_t)in[i] * 256;
+}
+
+static void convert_s16(cava_real *restrict out, const unsigned char *restrict in, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        int16_t v;
+        memcpy(&v, in + 2 * i, sizeof(v));
+        out[i] = (cava_real)v;
+    }
+}
+
+static void convert_s24(cava_real *restrict out, const unsigned char *restrict in, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        const unsigned char *p = in + 3 * i;
+        // assemble in the top 24 bits so the arithmetic shift sign-extends
+        int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+        out[i] = (cava_real)(v >> 8) * (cava_real)(1.0 / 256);
+    }
+}
+
+static void convert_s24_32(cava_real *restrict out, const unsigned char *restrict in,
+                           size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t v;
+        memcpy(&v, in + 4 * i, sizeof(v));
+        // low 24 bits carry the sample, the padding byte is not guaranteed to be a sign extension
+        v = (int32_t)((uint32_t)v << 8) >> 8;
+        out[i] = (cava_real)v * (cava_real)(1.0 / 256);
+    }
+}
+
+static void convert_s32(cava_real *restrict out, const unsigned char *restrict in, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t v;
+        memcpy(&v, in + 4 * i, sizeof(v));
+        out[i] = (cava_real)v * (cava_real)(1.0 / 65536);
+    }
+}
+
+static void convert_f32(cava_real *restrict out, const unsigned char *restrict in, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        float v;
+        memcpy(&v, in + 4 * i, sizeof(v));
+        out[i] = (cava_real)v * 32768;
+    }
+}
+
+static int sample_bytes(const struct audio_data *audio) {
+    return audio->sample_bytes > 0 ? audio->sample_bytes : audio->format / 8;
+}
+
+static int converter_key(const struct audio_data *audio) {
+    return audio->format | sample_bytes(audio) << 8 | (audio->IEEE_FLOAT != 0) << 12;
+}
+
+// picks the kernel for the current stream format. backends settle the format before the first
+// write, so this normally runs once; write_to_cava_input_buffers calls it again if it changes
+cava_convert_fn select_cava_input_converter(struct audio_data *audio) {
+    int bytes = sample_bytes(audio);
+    switch (audio->format) {
+    case 8:
+        audio->convert = convert_s8;
+        break;
+    case 24:
+        audio->convert = bytes == 4 ? convert_s24_32 : convert_s24;
+        break;
+    case 32:
+        audio->convert = audio->IEEE_FLOAT ? convert_f32 : convert_s32;
+        break;
+    default:
+        audio->convert = convert_s16;
+        break;
+    }
+    audio->convert_key = converter_key(audio);
+    return audio->convert;
+}
+
+int write_to_cava_input_buffers(int samples, unsigned char *buf, void *data) {
+    if (samples <= 0)
         return 0;
     struct audio_data *audio = (struct audio_data *)data;
-    pthread_mutex_lock(&audio->lock);
-    int bytes_per_sample = audio->format / 8;
-    if (audio->samples_counter + samples > audio->cava_buffer_size) {
-        // buffer overflow, discard what ever is in the buffer and start over
-        for (uint16_t n = 0; n < audio->cava_buffer_size; n++) {
-            audio->cava_in[n] = 0;
-        }
-        audio->samples_counter = 0;
-    }
-    int n = 0;
-    for (uint16_t i = 0; i < samples; i++) {
-        switch (bytes_per_sample) {
-        case 1:;
-            int8_t *buf8 = (int8_t *)&buf[n];
-            audio->cava_in[i + audio->samples_counter] = *buf8 * UCHAR_MAX;
-            break;
-        case 3:
-        case 4:;
-            if (audio->IEEE_FLOAT) {
-                float *ieee_float = (float *)&buf[n];
-                audio->cava_in[i + audio->samples_counter] = *ieee_float * USHRT_MAX;
-            } else {
-                int32_t *buf32 = (int32_t *)&buf[n];
-                audio->cava_in[i + audio->samples_counter] = (double)*buf32 / USHRT_MAX;
-            }
-            break;
-        default:;
-            int16_t *buf16 = (int16_t *)&buf[n];
-            audio->cava_in[i + audio->samples_counter] = *buf16;
-            break;
-        }
-        n += bytes_per_sample;
+    struct cava_ring *ring = &audio->ring;
+
+    struct cava_capture *capture = atomic_load_explicit(&audio->capture, memory_order_acquire);
+    if (capture != NULL)
+        cava_capture_write_audio(capture, audio, samples, buf);
+
+    cava_convert_fn convert = audio->convert;
+    if (convert == NULL || audio->convert_key != converter_key(audio))
+        convert = select_cava_input_converter(audio);
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t available = ring_free_samples(ring, head, audio->channels);
+    if ((size_t)samples > available) {
+        // the consumer fell behind, keep what is already queued and drop the rest of this block
+        atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ring->dropped_samples, samples - available,
+                                  memory_order_relaxed);
+        samples = available;
     }
-    audio->samples_counter += samples;
-    pthread_mutex_unlock(&audio->lock);
+
+    // convert straight into the ring in at most two runs, the second one after it wraps around
+    size_t start = head & (ring->capacity - 1);
+    size_t first = ring->capacity - start;
+    if (first > (size_t)samples)
+        first = samples;
+    convert(&ring->buffer[start], buf, first);
+    convert(ring->buffer, buf + first * sample_bytes(audio), samples - first);
+
+    publish_head(ring, head + samples);
     return 0;
 }
 
+int read_from_cava_input_buffers(struct audio_data *audio, cava_real *cava_in, int max_samples) {
+    struct cava_ring *ring = &audio->ring;
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    size_t queued = head - tail;
+    if (queued > (size_t)max_samples)
+        queued = max_samples;
+    if (audio->channels > 1)
+        queued -= queued % audio->channels;
+    if (queued == 0)
+        return 0;
+
+    // copy out in at most two contiguous runs, the second one after the ring wraps around
+    size_t start = tail & (ring->capacity - 1);
+    size_t first = ring->capacity - start;
+    if (first > queued)
+        first = queued;
+    memcpy(cava_in, &ring->buffer[start], first * sizeof(cava_real));
+    memcpy(cava_in + first, ring->buffer, (queued - first) * sizeof(cava_real));
+
+    atomic_store_explicit(&ring->tail, tail + queued, memory_order_release);
+    return (int)queued;
+}
+
 void reset_output_buffers(struct audio_data *data) {
-    struct audio_data *audio = (struct audio_data *)data;
-    pthread_mutex_lock(&audio->lock);
-    for (uint16_t n = 0; n < audio->cava_buffer_size; n++) {
-        audio->cava_in[n] = 0;
+    // queue a buffer worth of silence so the bars fall back down while the source is gone
+    struct cava_ring *ring = &data->ring;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t samples = ring_free_samples(ring, head, data->channels);
+    if (samples > (size_t)data->cava_buffer_size)
+        samples = data->cava_buffer_size;
+
+    size_t mask = ring->capacity - 1;
+    for (size_t n = 0; n < samples; n++) {
+        ring->buffer[(head + n) & mask] = 0;
     }
-    audio->samples_counter = audio->cava_buffer_size;
-    pthread_mutex_unlock(&audio->lock);
+    publish_head(ring, head + samples);
 }
 
 void signal_threadparams(struct audio_data *audio) {
     pthread_mutex_lock(&audio->lock);
     audio->threadparams = 0;
+    pthread_cond_broadcast(&audio->params_changed);
     pthread_mutex_unlock(&audio->lock);
 }
 
 void signal_terminate(struct audio_data *audio) {
     pthread_mutex_lock(&audio->lock);
     audio->terminate = 1;
+    pthread_cond_broadcast(&audio->params_changed);
     pthread_mutex_unlock(&audio->lock);
 }
@@ -4,10 +4,15 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cavacore.h"
+
 #ifndef _WIN32
 #include <unistd.h>
 #endif
@@ -15,8 +20,32 @@
 // number of samples to read from audio source per channel
 #define BUFFER_SIZE 512
 
+// wait-free single-producer/single-consumer sample ring between the input thread and the
+// visualizer. head and tail are free running counters, capacity is a power of two so the
+// slot of a counter is simply counter & (capacity - 1)
+struct cava_ring {
+    cava_real *buffer;
+    size_t capacity;
+    _Atomic size_t head;              // only advanced by the input thread
+    _Atomic size_t tail;              // only advanced by the consumer
+    _Atomic uint64_t overruns;        // number of writes that did not fit into the ring
+    _Atomic uint64_t dropped_samples; // samples discarded by those writes
+    _Atomic bool consumer_waiting;    // set while the consumer sleeps in wait_for_cava_input
+    int wakeup_fd;                    // eventfd the producer pokes when the consumer is waiting
+};
+
+struct cava_capture;
+
+// converts `samples` interleaved input samples to cava_real, scaled so full scale matches int16
+typedef void (*cava_convert_fn)(cava_real *restrict out, const unsigned char *restrict in,
+                                size_t samples);
+
 struct audio_data {
-    double *cava_in;
+    struct cava_ring ring;
+
+    // conversion kernel picked for the current format, see select_cava_input_converter
+    cava_convert_fn convert;
+    int convert_key;
 
     int input_buffer_size;
     int cava_buffer_size;
@@ -30,17 +59,29 @@ struct audio_data {
     int im;           // input mode alsa, fifo, pulse, portaudio, shmem or sndio
     int terminate;    // shared variable used to terminate audio thread
     char error_message[1024];
-    int samples_counter;
     int IEEE_FLOAT;   // format for 32bit (0=int, 1=float)
+    int sample_bytes; // bytes per sample in the stream, 0 means format / 8. 4 for 24bit in a
+                      // 32bit container (alsa/oss S24_LE), packed 24bit otherwise
     int autoconnect;  // auto connect to audio source (0=off, 1=once at startup, 2=regularly)
     int active;       // actively monitor sources when the graph is idle
     int remix;        // remix the incoming stream to this many channels
     int virtual_node; // set node.virtual to avoid recording notifications
+    int replay_realtime; // replay at the recorded pace (1) or as fast as the ring drains (0)
+    // when set, every block written to the ring is also appended here, see capture.h
+    _Atomic(struct cava_capture *) capture;
     pthread_mutex_t lock;
+    pthread_cond_t params_changed; // broadcast under lock when threadparams or terminate change
 };
 
 void reset_output_buffers(struct audio_data *data);
 void signal_threadparams(struct audio_data *data);
 void signal_terminate(struct audio_data *data);
 
-int write_to_cava_input_buffers(int16_t size, unsigned char *buf, void *data);
+int init_cava_input_ring(struct cava_ring *ring, size_t capacity);
+void free_cava_input_ring(struct cava_ring *ring);
+
+cava_convert_fn select_cava_input_converter(struct audio_data *audio);
+int write_to_cava_input_buffers(int samples, unsigned char *buf, void *data);
+int read_from_cava_input_buffers(struct audio_data *audio, cava_real *cava_in, int max_samples);
+void wait_for_cava_input(struct cava_ring *ring);
+void wake_cava_input_reader(struct cava_ring *ring);
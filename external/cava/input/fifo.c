@@ -1,14 +1,17 @@
 #include "input/fifo.h"
 #include "input/common.h"
 
+#include <poll.h>
 #include <time.h>
 
-int open_fifo(const char *path) {
-    int fd = open(path, O_RDONLY);
-    int flags = fcntl(fd, F_GETFL, 0);
-    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-    return fd;
-}
+// how long a silent fifo may stay quiet before the bars are dropped, and how often the thread looks at
+// audio->terminate afterwards. both only matter while nothing is being written
+#define FIFO_SILENCE_TIMEOUT_MS 100
+#define FIFO_IDLE_TIMEOUT_MS 1000
+
+// opened non-blocking so a missing writer never stalls us in open(); poll() does the waiting instead. a
+// reader that never saw a writer gets no POLLHUP, so the reopened fifo sleeps until someone connects
+int open_fifo(const char *path) { return open(path, O_RDONLY | O_NONBLOCK); }
 
 // input: FIFO
 void *input_fifo(void *data) {
@@ -23,29 +26,38 @@ void *input_fifo(void *data) {
         test_mode = 1;
     }
 
+    bool silent = false;
     while (!audio->terminate) {
-        int time_since_last_input = 0;
         unsigned int offset = 0;
-        do {
-            int num_read = read(fd, buf + offset, sizeof(buf) - offset);
-
-            if (num_read < 1) { // if no bytes read sleep 10ms and zero shared buffer
-                nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 10000000}, NULL);
-                time_since_last_input++;
-
-                if (time_since_last_input > 10) {
+        while (offset < sizeof(buf) && !audio->terminate) {
+            struct pollfd pfd = {.fd = fd, .events = POLLIN};
+            int ready = poll(&pfd, 1, silent ? FIFO_IDLE_TIMEOUT_MS : FIFO_SILENCE_TIMEOUT_MS);
+            if (ready == 0) {
+                // nothing written for a while, let the bars fall once and keep sleeping
+                if (!silent)
                     reset_output_buffers(audio);
-                    close(fd);
+                silent = true;
+                offset = 0;
+                continue;
+            }
+            if (ready < 0)
+                continue;
 
-                    fd = open_fifo(audio->source);
-                    time_since_last_input = 0;
-                    offset = 0;
-                }
-            } else {
+            int num_read = read(fd, buf + offset, sizeof(buf) - offset);
+            if (num_read > 0) {
                 offset += num_read;
-                time_since_last_input = 0;
+                silent = false;
+            } else if (num_read == 0 || (errno != EAGAIN && errno != EINTR)) {
+                // the writer hung up, reopen and wait for the next one
+                reset_output_buffers(audio);
+                close(fd);
+                fd = open_fifo(audio->source);
+                silent = true;
+                offset = 0;
             }
-        } while (offset < sizeof(buf));
+        }
+        if (offset < sizeof(buf))
+            break;
 
         write_to_cava_input_buffers(audio->input_buffer_size, buf, audio);
         if (test_mode) {
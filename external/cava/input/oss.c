@@ -143,6 +143,7 @@ void *input_oss(void *data) {
         bytes = 4; // = 32 / 8
     else
         bytes = audio->format / 8;
+    audio->sample_bytes = bytes;
 
     buf_size = audio->input_buffer_size * bytes;
 
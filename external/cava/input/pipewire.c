@@ -7,6 +7,10 @@
 
 #include <pipewire/pipewire.h>
 
+// requested quantum, as a fraction of a second so it holds at any graph rate (about 5 ms)
+#define PW_QUANTUM 256
+#define PW_QUANTUM_RATE 48000
+
 struct pw_data {
     struct pw_main_loop *loop;
     struct spa_source *timer;
@@ -34,12 +38,19 @@ static void on_process(void *userdata) {
     }
 
     buf = b->buffer;
-    if ((samples = buf->datas[0].data) == NULL)
+    if ((samples = buf->datas[0].data) == NULL) {
+        pw_stream_queue_buffer(data->stream, b);
         return;
+    }
 
-    n_samples = buf->datas[0].chunk->size / (data->cava_audio->format / 8);
+    // the mapped buffer goes straight into the ring, converted on the way in. no intermediate copy
+    struct spa_chunk *chunk = buf->datas[0].chunk;
+    uint32_t offset = SPA_MIN(chunk->offset, buf->datas[0].maxsize);
+    uint32_t size = SPA_MIN(chunk->size, buf->datas[0].maxsize - offset);
+    unsigned char *bytes = SPA_PTROFF(samples, offset, unsigned char);
+    n_samples = size / (data->cava_audio->format / 8);
 
-    write_to_cava_input_buffers(n_samples, buf->datas[0].data, data->cava_audio);
+    write_to_cava_input_buffers(n_samples, bytes, data->cava_audio);
 
     pw_stream_queue_buffer(data->stream, b);
 }
@@ -69,7 +80,7 @@ static void on_timeout(void *userdata, uint64_t expirations) {
 
 static void on_stream_state_changed(void *_data, [[maybe_unused]] enum pw_stream_state old,
                                     enum pw_stream_state state,
-                                    [[maybe_unused]] const char *error) {
+                                    const char *error) {
     struct pw_data *data = _data;
 
     data->idle = false;
@@ -90,7 +101,10 @@ static void on_stream_state_changed(void *_data, [[maybe_unused]] enum pw_stream
         break;
     case PW_STREAM_STATE_ERROR:
     case PW_STREAM_STATE_UNCONNECTED:
-        data->cava_audio->terminate = 1;
+        if (error)
+            snprintf(data->cava_audio->error_message, sizeof(data->cava_audio->error_message),
+                     __FILE__ ": stream error: %s", error);
+        signal_terminate(data->cava_audio);
         pw_main_loop_quit(data->loop);
         break;
     default:
@@ -112,6 +126,12 @@ static void on_stream_param_changed(void *_data, uint32_t id, const struct spa_p
         return;
 
     spa_format_audio_raw_parse(param, &data->format.info.raw);
+
+    // the graph picked the rate, let the main thread build its plan for it
+    if (data->cava_audio->threadparams && data->format.info.raw.rate > 0) {
+        data->cava_audio->rate = data->format.info.raw.rate;
+        signal_threadparams(data->cava_audio);
+    }
 }
 
 static const struct pw_stream_events stream_events = {
@@ -145,13 +165,11 @@ void *input_pipewire(void *audiodata) {
     uint8_t buffer[data.cava_audio->input_buffer_size];
     struct pw_properties *props;
     struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
-    uint32_t nom;
-    nom = next_power_of_2((512 * data.cava_audio->rate / 48000));
     pw_init(0, 0);
 
     data.loop = pw_main_loop_new(NULL);
     if (data.loop == NULL) {
-        data.cava_audio->terminate = 1;
+        signal_terminate(data.cava_audio);
         sprintf(data.cava_audio->error_message,
                 __FILE__ ": Could not create main loop. Is your system running pipewire? Maybe try "
                          "pulse input method instead.");
@@ -175,7 +193,14 @@ void *input_pipewire(void *audiodata) {
     } else if (strcmp(source, "auto_input") != 0) {
         pw_properties_set(props, PW_KEY_TARGET_OBJECT, source);
     }
-    pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", nom, data.cava_audio->rate);
+    // with a fixed rate keep the old behaviour of ~512 frames at 48k, otherwise ask for a small quantum
+    // and let pipewire scale it to the graph rate
+    if (data.cava_audio->rate > 0) {
+        uint32_t nom = next_power_of_2((512 * data.cava_audio->rate / 48000));
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", nom, data.cava_audio->rate);
+    } else {
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", PW_QUANTUM, PW_QUANTUM_RATE);
+    }
 
     if (data.cava_audio->active)
         pw_properties_set(props, PW_KEY_NODE_ALWAYS_PROCESS, "true");
@@ -198,10 +223,11 @@ void *input_pipewire(void *audiodata) {
         audio_format = SPA_AUDIO_FORMAT_S24;
         break;
     case 32:
-        audio_format = SPA_AUDIO_FORMAT_S32;
+        audio_format = data.cava_audio->IEEE_FLOAT ? SPA_AUDIO_FORMAT_F32 : SPA_AUDIO_FORMAT_S32;
         break;
     };
 
+    // a rate of 0 is left out of the EnumFormat, so the stream follows the graph rate
     if (data.cava_audio->remix) {
         pw_properties_set(props, PW_KEY_STREAM_DONT_REMIX, "false");
         pw_properties_set(props, "channelmix.upmix", "true");
@@ -238,7 +264,7 @@ void *input_pipewire(void *audiodata) {
                                    params, 1);
 
     if (status < 0) {
-        data.cava_audio->terminate = 1;
+        signal_terminate(data.cava_audio);
         sprintf(data.cava_audio->error_message,
                 __FILE__ ": Could not connect stream. Is your system running pipewire? Maybe try "
                          "pulse input method instead.");
@@ -178,7 +178,7 @@ void *input_portaudio(void *audiodata) {
         exit(EXIT_FAILURE);
     }
 
-    audio->threadparams = 0;
+    signal_threadparams(audio);
 
     // main loop
     while (1) {
@@ -0,0 +1,98 @@
+#include "input/replay.h"
+#include "input/capture.h"
+#include "input/common.h"
+
+#include <time.h>
+
+// longest single sleep while pacing, so a long gap in the capture does not delay terminate
+#define REPLAY_MAX_SLEEP_NS 100000000L
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns) {
+    if (ns > REPLAY_MAX_SLEEP_NS)
+        ns = REPLAY_MAX_SLEEP_NS;
+    nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = (long)ns}, NULL);
+}
+
+// at maximum speed a block is only written once the ring has room for all of it, so unlike a live
+// source the replay never overruns and the analysis sees every captured sample
+static void wait_for_room(struct audio_data *audio, size_t samples) {
+    struct cava_ring *ring = &audio->ring;
+    while (!audio->terminate) {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (ring->capacity - (head - tail) >= samples)
+            return;
+        sleep_ns(1000000);
+    }
+}
+
+// input: capture file written with cava_capture_create, played in a loop
+void *input_replay(void *data) {
+    struct audio_data *audio = (struct audio_data *)data;
+
+    struct cava_capture_info info;
+    struct cava_capture *capture =
+        cava_capture_open(audio->source, &info, audio->error_message, sizeof(audio->error_message));
+    if (capture == NULL) {
+        signal_terminate(audio);
+        return 0;
+    }
+
+    pthread_mutex_lock(&audio->lock);
+    audio->rate = info.rate;
+    audio->channels = info.channels;
+    audio->format = info.format;
+    audio->sample_bytes = info.sample_bytes;
+    audio->IEEE_FLOAT = info.IEEE_FLOAT;
+    pthread_mutex_unlock(&audio->lock);
+    signal_threadparams(audio);
+
+    // one pass per loop iteration, the clock restarts with the first block of each pass
+    int have_audio = 1;
+    while (!audio->terminate && have_audio) {
+        have_audio = 0;
+        uint64_t pass_start = monotonic_ns();
+        uint64_t first_block = 0;
+
+        struct cava_capture_record record;
+        int status = 0;
+        while (!audio->terminate && (status = cava_capture_read(capture, &record)) > 0) {
+            if (record.type != CAVA_CAPTURE_AUDIO || record.count == 0)
+                continue;
+            if (!have_audio)
+                first_block = record.time_ns;
+            have_audio = 1;
+
+            if (audio->replay_realtime) {
+                uint64_t due = pass_start + (record.time_ns - first_block);
+                uint64_t now;
+                while (!audio->terminate && (now = monotonic_ns()) < due)
+                    sleep_ns(due - now);
+            } else {
+                wait_for_room(audio, record.count);
+            }
+            write_to_cava_input_buffers(record.count, (unsigned char *)record.payload, audio);
+        }
+        if (status < 0)
+            fprintf(stderr, __FILE__ ": %s is truncated, starting over\n", audio->source);
+
+        // let the bars fall between passes, like a source that went quiet
+        reset_output_buffers(audio);
+        if (cava_capture_rewind(capture) != 0)
+            break;
+    }
+    if (!have_audio && !audio->terminate) {
+        snprintf(audio->error_message, sizeof(audio->error_message),
+                 __FILE__ ": %s holds no audio", audio->source);
+        signal_terminate(audio);
+    }
+
+    cava_capture_close(capture);
+    return 0;
+}
@@ -0,0 +1,5 @@
+// header files for capture replay, part of cava
+
+#pragma once
+
+void *input_replay(void *data);
@@ -1,28 +1,32 @@
 #include "input_methods.h"
 #include "input/common.h"
 
-#ifdef __GNUC__
-// curses.h or other sources may already define
-#undef GCC_UNUSED
-#define GCC_UNUSED __attribute__((unused))
-#else
-#define GCC_UNUSED /* nothing */
-#endif
-
 #if INPUT_AUDIO_METHOD == INPUT_PULSE
 #include "input/pulse.h"
+#elif INPUT_AUDIO_METHOD == INPUT_PIPEWIRE
+#include "input/pipewire.h"
 #endif
 
 // Declare the backends (all exist in input/*.c)
 void *input_fifo(void *arg);
 void *input_pulse(void *arg);
 void *input_alsa(void *arg);
+void *input_replay(void *arg);
 
-void create_input_thread(pthread_t *p_thread, struct audio_data *audio, int sample_rate,
-                         int sample_bits) {
+int wait_for_input_params(struct audio_data *audio) {
+    pthread_mutex_lock(&audio->lock);
+    while (audio->threadparams && !audio->terminate)
+        pthread_cond_wait(&audio->params_changed, &audio->lock);
+    int status = audio->terminate ? -1 : 0;
+    pthread_mutex_unlock(&audio->lock);
+    return status;
+}
+
+// state every backend starts from, before it fills in its own format. returns -1 with terminate
+// set and the reason in error_message if the ring cannot be allocated, so no thread is started
+static int init_audio_data(struct audio_data *audio) {
     audio->format = -1;
     audio->rate = 0;
-    audio->samples_counter = 0;
     audio->channels = 2;
     audio->IEEE_FLOAT = 0;
     audio->autoconnect = 0;
@@ -30,23 +34,43 @@ void create_input_thread(pthread_t *p_thread, struct audio_data *audio, int samp
     audio->input_buffer_size = BUFFER_SIZE * audio->channels;
     audio->cava_buffer_size = 16384;
 
-    audio->cava_in = (double *)malloc(audio->cava_buffer_size * sizeof(double));
-    memset(audio->cava_in, 0, audio->cava_buffer_size * sizeof(double));
-
     audio->threadparams = 0;
     audio->terminate = 0;
 
-    int thr_id GCC_UNUSED;
-
     pthread_mutex_init(&audio->lock, NULL);
+    pthread_cond_init(&audio->params_changed, NULL);
+
+    if (init_cava_input_ring(&audio->ring, audio->cava_buffer_size) != 0) {
+        snprintf(audio->error_message, sizeof(audio->error_message),
+                 __FILE__ ": could not allocate the input ring");
+        audio->terminate = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// a backend that failed to start never clears threadparams, so the failure has to end the wait
+static void start_input_thread(pthread_t *p_thread, struct audio_data *audio,
+                               void *(*input)(void *), const char *name) {
+    if (pthread_create(p_thread, NULL, input, audio) != 0) {
+        snprintf(audio->error_message, sizeof(audio->error_message),
+                 __FILE__ ": could not start the %s thread", name);
+        signal_terminate(audio);
+    }
+}
+
+void create_input_thread(pthread_t *p_thread, struct audio_data *audio, int sample_rate,
+                         int sample_bits) {
+    if (init_audio_data(audio) != 0)
+        return;
 
 #if INPUT_AUDIO_METHOD == INPUT_FIFO
     audio->rate = sample_rate;
     audio->format = sample_bits;
-    thr_id = pthread_create(p_thread, NULL, input_fifo, audio);
+    start_input_thread(p_thread, audio, input_fifo, "fifo");
 
 #elif INPUT_AUDIO_METHOD == INPUT_ALSA
-    thr_id = pthread_create(p_thread, NULL, input_alsa, (void *)&audio);
+    start_input_thread(p_thread, audio, input_alsa, "alsa");
 
 #elif INPUT_AUDIO_METHOD == INPUT_PULSE
     audio->format = 16;
@@ -55,7 +79,31 @@ void create_input_thread(pthread_t *p_thread, struct audio_data *audio, int samp
 
     getPulseDefaultSink(audio);
 
-    thr_id = pthread_create(p_thread, NULL, input_pulse, (void *)audio);
+    start_input_thread(p_thread, audio, input_pulse, "pulse");
+
+#elif INPUT_AUDIO_METHOD == INPUT_PIPEWIRE
+    // capture float32 at whatever rate the graph runs, so pipewire neither converts nor resamples.
+    // the rate is only known once the format is negotiated, cava_init has to wait for threadparams
+    audio->format = 32;
+    audio->IEEE_FLOAT = 1;
+    audio->rate = 0;
+    audio->source = strdup("auto");
+    audio->threadparams = 1;
+
+    start_input_thread(p_thread, audio, input_pipewire, "pipewire");
 
 #endif
 }
+
+void create_replay_thread(pthread_t *p_thread, struct audio_data *audio, const char *path,
+                          int realtime) {
+    if (init_audio_data(audio) != 0)
+        return;
+
+    // the format comes from the capture header, which the thread reads before clearing threadparams
+    audio->source = strdup(path);
+    audio->replay_realtime = realtime;
+    audio->threadparams = 1;
+
+    start_input_thread(p_thread, audio, input_replay, "replay");
+}
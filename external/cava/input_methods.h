@@ -3,6 +3,7 @@
 #define INPUT_FIFO 1
 #define INPUT_PULSE 2
 #define INPUT_ALSA 3
+#define INPUT_PIPEWIRE 4
 
 #ifndef INPUT_AUDIO_METHOD
 #error "You must define INPUT_AUDIO_METHOD at compile time."
@@ -12,3 +13,11 @@
 
 void create_input_thread(pthread_t *p_thread, struct audio_data *audio, int sample_rate,
                          int sample_bits);
+// plays a capture file (see input/capture.h) instead of a live source, in a loop. `realtime` keeps the
+// recorded pace, otherwise blocks are fed as fast as the ring drains. works with any INPUT_AUDIO_METHOD
+void create_replay_thread(pthread_t *p_thread, struct audio_data *audio, const char *path,
+                          int realtime);
+// blocks until the input thread settled rate/format (threadparams cleared). only backends that
+// negotiate the format set threadparams, for the others this returns right away. returns -1 if the
+// input thread terminated instead, with the reason in audio->error_message
+int wait_for_input_params(struct audio_data *audio);
@@ -20,11 +20,13 @@
           wayland-scanner
           wayland-protocols
           libffi
-          libGLU
+          libGL
           egl-wayland
           libxkbcommon
           fftw
+          fftwFloat
           pulseaudio
+          pipewire
         ];
       in {
         packages.default = pkgs.stdenv.mkDerivation {
@@ -0,0 +1,181 @@
+#ifndef YWP_BARS_H
+#define YWP_BARS_H
+
+// Reader side of the bar segment ywp publishes with `--publish`. Header only, no dependencies beyond libc, so a
+// status bar or widget can include it as is:
+//
+//     struct ywp_bars_reader reader;
+//     if (ywp_bars_open(&reader, NULL) == 0)
+//     {
+//         float bars[YWP_BARS_MAX];
+//         struct ywp_bars_info info;
+//         int count = ywp_bars_read(&reader, bars, YWP_BARS_MAX, &info);
+//         ...
+//         ywp_bars_close(&reader);
+//     }
+//
+// The segment is a POSIX shared memory object holding a fixed header followed by the bars. It is written by a
+// single writer under a sequence lock: `sequence` is odd while an update is in progress and increases by two
+// with every frame, so readers never block the writer and only retry when they raced with it.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YWP_BARS_MAGIC 0x53524142u // "BARS"
+#define YWP_BARS_VERSION 1
+// Default object name is this prefix followed by the user id, see ywp_bars_default_name
+#define YWP_BARS_NAME_PREFIX "/ywp-bars-"
+// Upper bound on the bars in one segment
+#define YWP_BARS_MAX 512
+
+// Set in `flags` while ywp has suspended analysis on silence; the bars stay at zero until sound returns
+#define YWP_BARS_IDLE 0x1u
+// Set in `flags` by the last frame before ywp exits or recreates the segment; reopen to follow a new instance
+#define YWP_BARS_CLOSED 0x2u
+
+// Read attempts before ywp_bars_read gives up on a writer that keeps racing it
+#define YWP_BARS_READ_ATTEMPTS 64
+
+struct ywp_bars_shm
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity; // Bars the segment has room for
+    uint32_t pid;      // Writer process
+    uint64_t sequence; // Accessed with atomics only; odd while the fields below are being updated
+
+    uint64_t frame;        // Analysis frames published so far
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC time the frame was analyzed
+    uint32_t num_bars;     // Bars in this frame: all left-channel bars low to high, then the right channel's
+    uint32_t channels;
+    uint32_t sample_rate; // Of the captured audio, in Hz
+    uint32_t flags;       // YWP_BARS_*
+    float bars[];         // 0.0 to 1.0, usually
+};
+
+// Everything in a frame but the bars, copied out by ywp_bars_read
+struct ywp_bars_info
+{
+    uint64_t frame;
+    uint64_t timestamp_ns;
+    uint32_t num_bars;
+    uint32_t channels;
+    uint32_t sample_rate;
+    uint32_t flags;
+};
+
+struct ywp_bars_reader
+{
+    const struct ywp_bars_shm *shm;
+    size_t size;
+};
+
+static inline size_t ywp_bars_size(uint32_t capacity)
+{
+    return sizeof(struct ywp_bars_shm) + (size_t)capacity * sizeof(float);
+}
+
+// Writes "/ywp-bars-<uid>", the name ywp publishes under unless told otherwise
+static inline void ywp_bars_default_name(char *name, size_t size)
+{
+    snprintf(name, size, YWP_BARS_NAME_PREFIX "%u", (unsigned int)getuid());
+}
+
+// Maps the segment `name` (NULL for the default) read-only. Returns 0 on success, -1 if no compatible writer
+// has created it.
+static inline int ywp_bars_open(struct ywp_bars_reader *reader, const char *name)
+{
+    char default_name[64];
+    if (name == NULL)
+    {
+        ywp_bars_default_name(default_name, sizeof(default_name));
+        name = default_name;
+    }
+
+    reader->shm = NULL;
+    reader->size = 0;
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct ywp_bars_shm))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const struct ywp_bars_shm *shm = (const struct ywp_bars_shm *)map;
+    if (shm->magic != YWP_BARS_MAGIC || shm->version != YWP_BARS_VERSION ||
+        ywp_bars_size(shm->capacity) > (size_t)st.st_size)
+    {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    reader->shm = shm;
+    reader->size = (size_t)st.st_size;
+    return 0;
+}
+
+static inline void ywp_bars_close(struct ywp_bars_reader *reader)
+{
+    if (reader->shm != NULL)
+        munmap((void *)reader->shm, reader->size);
+    reader->shm = NULL;
+    reader->size = 0;
+}
+
+// Copies the latest frame: up to `max_bars` bars into `bars` and the rest into `info` (may be NULL). Returns
+// the number of bars copied, 0 before the first frame, or -1 if the writer kept updating the segment
+// throughout YWP_BARS_READ_ATTEMPTS tries. Compare `info->frame` between calls to tell whether anything changed.
+static inline int ywp_bars_read(const struct ywp_bars_reader *reader, float *bars, int max_bars,
+                                struct ywp_bars_info *info)
+{
+    const struct ywp_bars_shm *shm = reader->shm;
+    for (int attempt = 0; attempt < YWP_BARS_READ_ATTEMPTS; attempt++)
+    {
+        uint64_t begin = __atomic_load_n(&shm->sequence, __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue;
+
+        struct ywp_bars_info snapshot;
+        snapshot.frame = shm->frame;
+        snapshot.timestamp_ns = shm->timestamp_ns;
+        snapshot.num_bars = shm->num_bars;
+        snapshot.channels = shm->channels;
+        snapshot.sample_rate = shm->sample_rate;
+        snapshot.flags = shm->flags;
+        uint32_t count = snapshot.num_bars;
+        if (count > shm->capacity)
+            count = shm->capacity;
+        if (max_bars >= 0 && count > (uint32_t)max_bars)
+            count = (uint32_t)max_bars;
+        memcpy(bars, shm->bars, count * sizeof(float));
+
+        // Orders the copies above before the second read of the sequence
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->sequence, __ATOMIC_RELAXED) != begin)
+            continue;
+
+        if (info != NULL)
+            *info = snapshot;
+        return begin == 0 ? 0 : (int)count;
+    }
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YWP_BARS_H
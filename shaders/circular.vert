@@ -1,10 +1,65 @@
 #version 310 es
 precision highp float;
 
-in vec4 a_position;
-uniform mat4 u_projection;
+#define PI 3.14159265358979323846
+#define INNER_CIRCLE_RADIUS 0.3
+#define OUTER_CIRCLE_RADIUS 0.9
 
+uniform vec2 u_viewport;
+uniform int u_num_bars;
+uniform int u_segments;
+
+layout(std430, binding = 0) readonly buffer CavaBuffer {
+    float cava_out[];
+};
+
+#define CATPPUCCIN_SIZE 14
+const vec3 catppuccin_mocha[CATPPUCCIN_SIZE] = vec3[](
+    vec3(0.961, 0.878, 0.863), // Rosewater
+    vec3(0.949, 0.804, 0.804), // Flamingo
+    vec3(0.961, 0.761, 0.906), // Pink
+    vec3(0.796, 0.651, 0.969), // Mauve
+    vec3(0.953, 0.545, 0.659), // Red
+    vec3(0.922, 0.627, 0.675), // Maroon
+    vec3(0.980, 0.702, 0.529), // Peach
+    vec3(0.976, 0.886, 0.686), // Yellow
+    vec3(0.651, 0.890, 0.631), // Green
+    vec3(0.580, 0.886, 0.835), // Teal
+    vec3(0.537, 0.863, 0.922), // Sky
+    vec3(0.455, 0.780, 0.925), // Sapphire
+    vec3(0.537, 0.706, 0.980), // Blue
+    vec3(0.706, 0.745, 0.996)  // Lavender
+);
+
+const vec4 circle_color = vec4(0.804, 0.804, 0.957, 1.0);
+
+flat out vec4 v_color;
+
+// One instance per bar, each a triangle strip along the wedge: even vertices on the inner edge, odd ones on
+// the outer edge. The bars share the circle in (u_num_bars - 1) slices, so the last instance (whose slice would
+// start at a full turn) draws the centre disc instead.
 void main() {
-	gl_Position = u_projection * a_position;
-}
+	int idx = gl_InstanceID;
+	int column = gl_VertexID / 2;
+	bool outer = (gl_VertexID % 2) == 1;
+	float along = float(column) / float(u_segments);
 
+	float angle;
+	float radius;
+	if (idx == u_num_bars - 1) {
+		angle = along * 2.0 * PI;
+		radius = outer ? INNER_CIRCLE_RADIUS : 0.0;
+		v_color = circle_color;
+	} else {
+		float slice = 2.0 * PI / float(u_num_bars - 1);
+		angle = (float(idx) + along) * slice;
+		float val = clamp(cava_out[idx], 0.0, 1.0);
+		radius = outer ? INNER_CIRCLE_RADIUS + val * (OUTER_CIRCLE_RADIUS - INNER_CIRCLE_RADIUS) : INNER_CIRCLE_RADIUS;
+		v_color = vec4(catppuccin_mocha[idx % CATPPUCCIN_SIZE], 1.0);
+	}
+
+	// Radii are relative to half the largest square that fits the viewport, centred on the surface
+	float largest_square = min(u_viewport.x, u_viewport.y);
+	vec2 position = u_viewport / 2.0 + vec2(cos(angle), sin(angle)) * radius * (largest_square / 2.0);
+	gl_Position = vec4(position / u_viewport * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 310 es
+precision highp float;
+
+// Attribute-less full-screen triangle for fragment-only themes: vertices (-1,-1), (3,-1) and (-1,3) cover the
+// whole viewport with a single primitive, so there is no diagonal seam and no vertex buffer to bind.
+void main() {
+	vec2 position = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+	gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -1,10 +1,44 @@
 #version 310 es
 precision highp float;
 
-in vec4 a_position;
-uniform mat4 u_projection;
+uniform int u_num_bars;
+uniform int u_segments;
 
-void main() {
-	gl_Position = u_projection * a_position;
+layout(std430, binding = 0) readonly buffer CavaBuffer {
+    float cava_out[];
+};
+
+float catmullRom(float p0, float p1, float p2, float p3, float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5 * (
+        (2.0 * p1) +
+        (-p0 + p2) * t +
+        (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t2 +
+        (-p0 + 3.0 * p1 - 3.0 * p2 + p3) * t3
+    );
 }
 
+// A single triangle strip across the surface: even vertices sit on the bottom edge, odd ones on the spline.
+// The spline is evaluated once per column (u_segments columns per bar) instead of once per pixel.
+void main() {
+    int column = gl_VertexID / 2;
+    int columns = (u_num_bars - 1) * u_segments;
+    float x_norm = float(column) / float(columns);
+
+    float y_norm = 0.0;
+    if ((gl_VertexID % 2) == 1) {
+        float global_pos = x_norm * float(u_num_bars - 1);
+        int idx = min(int(global_pos), u_num_bars - 1);
+        float t = global_pos - float(idx);
+
+        int i0 = clamp(idx - 1, 0, u_num_bars - 1);
+        int i1 = clamp(idx,     0, u_num_bars - 1);
+        int i2 = clamp(idx + 1, 0, u_num_bars - 1);
+        int i3 = clamp(idx + 2, 0, u_num_bars - 1);
+
+        y_norm = max(catmullRom(cava_out[i0], cava_out[i1], cava_out[i2], cava_out[i3], t), 0.0);
+    }
+
+    gl_Position = vec4(x_norm * 2.0 - 1.0, y_norm * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,44 @@
+#version 310 es
+precision highp float;
+
+uniform vec2 u_viewport;
+uniform int u_num_bars;
+uniform int u_history_head;
+uniform highp sampler2D u_history;
+
+#define CATPPUCCIN_SIZE 14
+const vec3 catppuccin_mocha[CATPPUCCIN_SIZE] = vec3[](
+    vec3(0.961, 0.878, 0.863), // Rosewater
+    vec3(0.949, 0.804, 0.804), // Flamingo
+    vec3(0.961, 0.761, 0.906), // Pink
+    vec3(0.796, 0.651, 0.969), // Mauve
+    vec3(0.953, 0.545, 0.659), // Red
+    vec3(0.922, 0.627, 0.675), // Maroon
+    vec3(0.980, 0.702, 0.529), // Peach
+    vec3(0.976, 0.886, 0.686), // Yellow
+    vec3(0.651, 0.890, 0.631), // Green
+    vec3(0.580, 0.886, 0.835), // Teal
+    vec3(0.537, 0.863, 0.922), // Sky
+    vec3(0.455, 0.780, 0.925), // Sapphire
+    vec3(0.537, 0.706, 0.980), // Blue
+    vec3(0.706, 0.745, 0.996)  // Lavender
+);
+
+const vec3 background = vec3(30.0, 30.0, 46.0) / 255.0;
+// How much of its brightness the oldest row has lost
+#define AGE_FADE 0.6
+
+out vec4 fragColor;
+
+// Spectrogram scrolling down from the top edge: one column per bar and one row per past analysis frame, read
+// straight from the history ring (row u_history_head is the newest frame)
+void main() {
+    int rows = textureSize(u_history, 0).y;
+    int bar = min(int(gl_FragCoord.x / u_viewport.x * float(u_num_bars)), u_num_bars - 1);
+    int age = min(int((1.0 - gl_FragCoord.y / u_viewport.y) * float(rows)), rows - 1);
+    int row = (u_history_head - age + rows) % rows;
+
+    float value = clamp(texelFetch(u_history, ivec2(bar, row), 0).r, 0.0, 1.0);
+    float fade = 1.0 - AGE_FADE * float(age) / float(rows);
+    fragColor = vec4(mix(background, catppuccin_mocha[bar % CATPPUCCIN_SIZE], value * fade), 1.0);
+}
@@ -0,0 +1,90 @@
+#include "bar_buffer.h"
+#include "metrics.h"
+#include <string.h>
+
+// How long we are willing to block if the GPU is more than BAR_BUFFER_SLOTS frames behind
+#define FENCE_TIMEOUT_NS 100000000ull
+
+bool bar_buffer_init(BarBuffer *bars, int num_bars)
+{
+    memset(bars, 0, sizeof(*bars));
+    bars->num_bars = num_bars;
+
+    GLint alignment = 1;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1)
+        alignment = 1;
+    GLsizeiptr size = sizeof(float) * num_bars;
+    bars->slot_stride = (size + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &bars->buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bars->buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bars->slot_stride * BAR_BUFFER_SLOTS, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+void bar_buffer_destroy(BarBuffer *bars)
+{
+    for (int i = 0; i < BAR_BUFFER_SLOTS; i++)
+    {
+        if (bars->fences[i])
+            glDeleteSync(bars->fences[i]);
+    }
+    glDeleteBuffers(1, &bars->buffer);
+    memset(bars, 0, sizeof(*bars));
+}
+
+bool bar_buffer_resize(BarBuffer *bars, int num_bars)
+{
+    if ((GLsizeiptr)sizeof(float) * num_bars <= bars->slot_stride)
+    {
+        bars->num_bars = num_bars;
+        return true;
+    }
+    // The GPU keeps the old buffer alive until the draws still reading it have finished
+    bar_buffer_destroy(bars);
+    return bar_buffer_init(bars, num_bars);
+}
+
+void bar_buffer_upload(BarBuffer *bars, const float *values)
+{
+    int slot = (bars->current + 1) % BAR_BUFFER_SLOTS;
+    GLsync fence = bars->fences[slot];
+    if (fence)
+    {
+        // With three slots this has always signalled unless the GPU is badly behind
+        if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED)
+            atomic_fetch_add_explicit(&metrics.fence_timeouts, 1, memory_order_relaxed);
+        glDeleteSync(fence);
+        bars->fences[slot] = NULL;
+    }
+
+    GLintptr offset = bars->slot_stride * slot;
+    GLsizeiptr size = sizeof(float) * bars->num_bars;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bars->buffer);
+    void *mapped = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, offset, size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped)
+    {
+        memcpy(mapped, values, size);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    else
+    {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, values);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bars->buffer, offset, size);
+    bars->current = slot;
+}
+
+void bar_buffer_fence(BarBuffer *bars)
+{
+    if (bars->fences[bars->current])
+        glDeleteSync(bars->fences[bars->current]);
+    bars->fences[bars->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
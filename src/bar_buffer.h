@@ -0,0 +1,32 @@
+#ifndef BAR_BUFFER_H
+#define BAR_BUFFER_H
+
+#include <GLES3/gl31.h>
+#include <stdbool.h>
+
+#define BAR_BUFFER_SLOTS 3
+
+// Ring of SSBO slots the bars are streamed through. Each frame writes the next slot with an unsynchronized map
+// and binds it to `CavaBuffer` (binding 0); a fence per slot guarantees we never overwrite bars the GPU may still
+// be reading, so uploading never stalls on the previous frame's draw.
+typedef struct
+{
+    GLuint buffer;
+    GLsizeiptr slot_stride; // Slot size rounded up to GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+    int num_bars;
+    int current;
+    GLsync fences[BAR_BUFFER_SLOTS];
+} BarBuffer;
+
+bool bar_buffer_init(BarBuffer *bars, int num_bars);
+void bar_buffer_destroy(BarBuffer *bars);
+// Changes the bars per upload; the slots are only reallocated when they are too small
+bool bar_buffer_resize(BarBuffer *bars, int num_bars);
+
+// Copies `values` into the next free slot and binds it for the following draws, which keep reading it until the
+// next upload
+void bar_buffer_upload(BarBuffer *bars, const float *values);
+// Marks the slot uploaded last as in use by the commands issued so far; call after the draw
+void bar_buffer_fence(BarBuffer *bars);
+
+#endif // BAR_BUFFER_H
@@ -0,0 +1,49 @@
+#include "bar_history.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool bar_history_init(BarHistory *history, int num_bars)
+{
+    memset(history, 0, sizeof(*history));
+    history->num_bars = num_bars;
+    history->head = BAR_HISTORY_ROWS - 1;
+
+    float *zeros = calloc((size_t)num_bars * BAR_HISTORY_ROWS, sizeof(float));
+    if (zeros == NULL)
+        return false;
+
+    glActiveTexture(GL_TEXTURE0 + BAR_HISTORY_UNIT);
+    glGenTextures(1, &history->texture);
+    glBindTexture(GL_TEXTURE_2D, history->texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, num_bars, BAR_HISTORY_ROWS);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, num_bars, BAR_HISTORY_ROWS, GL_RED, GL_FLOAT, zeros);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+    free(zeros);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+void bar_history_destroy(BarHistory *history)
+{
+    glDeleteTextures(1, &history->texture);
+    memset(history, 0, sizeof(*history));
+}
+
+bool bar_history_resize(BarHistory *history, int num_bars)
+{
+    if (num_bars == history->num_bars)
+        return true;
+    bar_history_destroy(history);
+    return bar_history_init(history, num_bars);
+}
+
+void bar_history_push(BarHistory *history, const float *values)
+{
+    history->head = (history->head + 1) % BAR_HISTORY_ROWS;
+    glActiveTexture(GL_TEXTURE0 + BAR_HISTORY_UNIT);
+    glBindTexture(GL_TEXTURE_2D, history->texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, history->head, history->num_bars, 1, GL_RED, GL_FLOAT, values);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,32 @@
+#ifndef BAR_HISTORY_H
+#define BAR_HISTORY_H
+
+#include <GLES3/gl31.h>
+#include <stdbool.h>
+
+// Analysis frames kept on the GPU
+#define BAR_HISTORY_ROWS 256
+// Texture unit `u_history` is bound to; unit 0 is left to whoever needs a scratch binding
+#define BAR_HISTORY_UNIT 1
+
+// Ring of past bar frames in an R32F texture, one row per frame and one column per bar. Each fresh frame
+// overwrites the oldest row, so shaders can look back BAR_HISTORY_ROWS frames (waterfalls, trails) while the
+// upload stays a single row. `head` is the row of the newest frame; the frame `age` frames older is in row
+// (head - age) mod BAR_HISTORY_ROWS. Read it with texelFetch: float textures are not filterable in GLES.
+typedef struct
+{
+    GLuint texture;
+    int num_bars;
+    int head;
+} BarHistory;
+
+// Allocates the texture, all zero, and binds it to BAR_HISTORY_UNIT
+bool bar_history_init(BarHistory *history, int num_bars);
+void bar_history_destroy(BarHistory *history);
+// Reallocates the texture for another number of bars. Past frames are dropped, the rows start over at zero.
+bool bar_history_resize(BarHistory *history, int num_bars);
+
+// Writes `values` as the newest row
+void bar_history_push(BarHistory *history, const float *values);
+
+#endif // BAR_HISTORY_H
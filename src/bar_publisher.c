@@ -0,0 +1,113 @@
+#include "bar_publisher.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+bool bar_publisher_init(BarPublisher *publisher, const char *name, int num_bars, int channels,
+                        unsigned int sample_rate)
+{
+    memset(publisher, 0, sizeof(*publisher));
+    if (num_bars <= 0 || num_bars > YWP_BARS_MAX)
+        return false;
+    if (name != NULL)
+        snprintf(publisher->name, sizeof(publisher->name), "%s", name);
+    else
+        ywp_bars_default_name(publisher->name, sizeof(publisher->name));
+
+    // Always start from a new object: readers still mapping a segment left by a crashed instance keep their old
+    // (now unlinked) mapping instead of seeing it resized underneath them
+    shm_unlink(publisher->name);
+    int fd = shm_open(publisher->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        printf("Could not create shared memory %s: %s\n", publisher->name, strerror(errno));
+        return false;
+    }
+
+    publisher->size = ywp_bars_size((uint32_t)num_bars);
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)publisher->size) == 0)
+        map = mmap(NULL, publisher->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        printf("Could not map shared memory %s: %s\n", publisher->name, strerror(errno));
+        shm_unlink(publisher->name);
+        return false;
+    }
+
+    // ftruncate zero-fills, so `sequence` starts at 0: no frame yet
+    publisher->shm = map;
+    publisher->shm->magic = YWP_BARS_MAGIC;
+    publisher->shm->version = YWP_BARS_VERSION;
+    publisher->shm->capacity = (uint32_t)num_bars;
+    publisher->shm->pid = (uint32_t)getpid();
+    publisher->shm->num_bars = (uint32_t)num_bars;
+    publisher->shm->channels = (uint32_t)channels;
+    publisher->shm->sample_rate = sample_rate;
+    return true;
+}
+
+void bar_publisher_destroy(BarPublisher *publisher)
+{
+    if (publisher->shm == NULL)
+        return;
+
+    bar_publisher_write(publisher, publisher->shm->bars, YWP_BARS_CLOSED);
+    munmap(publisher->shm, publisher->size);
+    shm_unlink(publisher->name);
+    publisher->shm = NULL;
+}
+
+// Single writer, so a plain load is enough to pick the next sequence numbers. The odd value has to be visible
+// before any of the stores of the update, the even one after all of them.
+static uint64_t begin_update(struct ywp_bars_shm *shm)
+{
+    uint64_t sequence = __atomic_load_n(&shm->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return sequence;
+}
+
+static void end_update(struct ywp_bars_shm *shm, uint64_t sequence)
+{
+    __atomic_store_n(&shm->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+bool bar_publisher_resize(BarPublisher *publisher, int num_bars)
+{
+    struct ywp_bars_shm *shm = publisher->shm;
+    if (num_bars > 0 && (uint32_t)num_bars <= shm->capacity)
+    {
+        uint64_t sequence = begin_update(shm);
+        shm->num_bars = (uint32_t)num_bars;
+        end_update(shm, sequence);
+        return true;
+    }
+
+    // Readers see the old segment closed and reopen the new one, as after a restart
+    char name[NAME_MAX];
+    snprintf(name, sizeof(name), "%s", publisher->name);
+    int channels = (int)shm->channels;
+    unsigned int sample_rate = shm->sample_rate;
+    bar_publisher_destroy(publisher);
+    return bar_publisher_init(publisher, name, num_bars, channels, sample_rate);
+}
+
+void bar_publisher_write(BarPublisher *publisher, const float *bars, uint32_t flags)
+{
+    struct ywp_bars_shm *shm = publisher->shm;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t sequence = begin_update(shm);
+    shm->frame++;
+    shm->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    shm->flags = flags;
+    memmove(shm->bars, bars, shm->num_bars * sizeof(float));
+    end_update(shm, sequence);
+}
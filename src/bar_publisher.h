@@ -0,0 +1,32 @@
+#ifndef BAR_PUBLISHER_H
+#define BAR_PUBLISHER_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ywp_bars.h"
+
+// Writer side of the shared bar segment described in include/ywp_bars.h. Owned by the DSP worker, which
+// publishes every analysis frame into it; any number of widgets map it read-only.
+typedef struct
+{
+    char name[NAME_MAX];
+    struct ywp_bars_shm *shm;
+    size_t size;
+} BarPublisher;
+
+// Creates (or replaces a stale) segment `name`, NULL for the per-user default, with room for `num_bars`
+bool bar_publisher_init(BarPublisher *publisher, const char *name, int num_bars, int channels,
+                        unsigned int sample_rate);
+// Marks the segment closed for readers still mapping it, then unlinks it
+void bar_publisher_destroy(BarPublisher *publisher);
+
+// Changes the bars per frame. A count beyond the segment's capacity replaces the segment with a larger one;
+// returns false if that fails, leaving the publisher closed.
+bool bar_publisher_resize(BarPublisher *publisher, int num_bars);
+
+// Publishes one frame of `num_bars` bars; `flags` are YWP_BARS_* bits
+void bar_publisher_write(BarPublisher *publisher, const float *bars, uint32_t flags);
+
+#endif // BAR_PUBLISHER_H
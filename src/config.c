@@ -0,0 +1,208 @@
+#include "config.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Values for options that only have a long form, outside the range of the short ones
+enum
+{
+    OPT_GENERATE_WISDOM = 0x100,
+    OPT_PUBLISH,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_REPLAY_FAST,
+};
+
+static void print_usage(const char *program)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Options:\n"
+           "  -t, --theme <name>      Visualizer to draw: circular, spline or waterfall (default %s)\n"
+           "  -f, --max-fps <fps>     Cap the render rate (default %d, 0 follows the monitor refresh)\n"
+           "  -i, --idle-timeout <s>  Suspend after this many seconds of silence (default %.0f, 0 never)\n"
+           "  -s, --render-scale <f>  Draw at this fraction of the resolution and upscale, %.2f-1 (default %.0f)\n"
+           "  -g, --gpu-budget <ms>   Lower the render scale while a draw takes longer on the GPU (default 0, off)\n"
+           "  -b, --bars <count>      Bars per channel (default %d)\n"
+           "  -l, --low-cut <hz>      Lowest frequency shown (default %d)\n"
+           "  -H, --high-cut <hz>     Highest frequency shown (default %d)\n"
+           "  -m, --smoothing <f>     Smoothing from 0 (fast, noisy) to 1 (slow, smooth) (default %.2f)\n"
+           "      --generate-wisdom   Pre-compute FFTW plans (FFTW_PATIENT) into the cache and exit\n"
+           "      --publish[=<name>]  Share the bars in shared memory (default /ywp-bars-<uid>)\n"
+           "      --record <file>     Record the audio blocks and the bars into a capture file\n"
+           "      --replay <file>     Play a capture file instead of the live source, in a loop\n"
+           "      --replay-fast       Replay as fast as the analysis consumes it, not at the recorded pace\n"
+           "  -h, --help              Show this message\n",
+           program, DEFAULT_THEME, DEFAULT_MAX_FPS, DEFAULT_IDLE_TIMEOUT, RENDER_SCALE_MIN, DEFAULT_RENDER_SCALE,
+           DEFAULT_BARS_PER_CHANNEL, DEFAULT_LOW_CUT_OFF, DEFAULT_HIGH_CUT_OFF, DEFAULT_NOISE_REDUCTION);
+}
+
+static bool parse_int(const char *value, int min, int *out)
+{
+    char *end = NULL;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < min)
+        return false;
+    *out = (int)parsed;
+    return true;
+}
+
+static bool parse_double(const char *value, double min, double *out)
+{
+    char *end = NULL;
+    double parsed = strtod(value, &end);
+    if (end == value || *end != '\0' || parsed < min)
+        return false;
+    *out = parsed;
+    return true;
+}
+
+bool parse_config(Config *config, int argc, char **argv, int *exit_code)
+{
+    config->theme = DEFAULT_THEME;
+    config->analysis.bars_per_channel = DEFAULT_BARS_PER_CHANNEL;
+    config->analysis.low_cut_off = DEFAULT_LOW_CUT_OFF;
+    config->analysis.high_cut_off = DEFAULT_HIGH_CUT_OFF;
+    config->analysis.noise_reduction = DEFAULT_NOISE_REDUCTION;
+    config->max_fps = DEFAULT_MAX_FPS;
+    config->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+    config->generate_wisdom = false;
+    config->publish = false;
+    config->publish_name = NULL;
+    config->render_scale = DEFAULT_RENDER_SCALE;
+    config->gpu_budget = 0.0;
+    config->record_path = NULL;
+    config->replay_path = NULL;
+    config->replay_fast = false;
+
+    static const struct option options[] = {
+        {"theme", required_argument, NULL, 't'},
+        {"max-fps", required_argument, NULL, 'f'},
+        {"idle-timeout", required_argument, NULL, 'i'},
+        {"render-scale", required_argument, NULL, 's'},
+        {"gpu-budget", required_argument, NULL, 'g'},
+        {"bars", required_argument, NULL, 'b'},
+        {"low-cut", required_argument, NULL, 'l'},
+        {"high-cut", required_argument, NULL, 'H'},
+        {"smoothing", required_argument, NULL, 'm'},
+        {"generate-wisdom", no_argument, NULL, OPT_GENERATE_WISDOM},
+        {"publish", optional_argument, NULL, OPT_PUBLISH},
+        {"record", required_argument, NULL, OPT_RECORD},
+        {"replay", required_argument, NULL, OPT_REPLAY},
+        {"replay-fast", no_argument, NULL, OPT_REPLAY_FAST},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:f:i:s:g:b:l:H:m:h", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            config->theme = optarg;
+            break;
+        case 'f':
+            if (!parse_int(optarg, 0, &config->max_fps))
+            {
+                fprintf(stderr, "Invalid --max-fps value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case 'i':
+            if (!parse_double(optarg, 0.0, &config->idle_timeout))
+            {
+                fprintf(stderr, "Invalid --idle-timeout value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case 's':
+        {
+            double scale = 0.0;
+            if (!parse_double(optarg, RENDER_SCALE_MIN, &scale) || scale > 1.0)
+            {
+                fprintf(stderr, "Invalid --render-scale value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            config->render_scale = (float)scale;
+            break;
+        }
+        case 'g':
+            if (!parse_double(optarg, 0.0, &config->gpu_budget))
+            {
+                fprintf(stderr, "Invalid --gpu-budget value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case 'b':
+            if (!parse_int(optarg, 1, &config->analysis.bars_per_channel))
+            {
+                fprintf(stderr, "Invalid --bars value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case 'l':
+            if (!parse_int(optarg, 1, &config->analysis.low_cut_off))
+            {
+                fprintf(stderr, "Invalid --low-cut value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case 'H':
+            if (!parse_int(optarg, 1, &config->analysis.high_cut_off))
+            {
+                fprintf(stderr, "Invalid --high-cut value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case 'm':
+            if (!parse_double(optarg, 0.0, &config->analysis.noise_reduction) ||
+                config->analysis.noise_reduction > 1.0)
+            {
+                fprintf(stderr, "Invalid --smoothing value: %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            break;
+        case OPT_GENERATE_WISDOM:
+            config->generate_wisdom = true;
+            break;
+        case OPT_PUBLISH:
+            if (optarg != NULL && optarg[0] != '/')
+            {
+                fprintf(stderr, "Invalid --publish name (must start with '/'): %s\n", optarg);
+                *exit_code = 1;
+                return false;
+            }
+            config->publish = true;
+            config->publish_name = optarg;
+            break;
+        case OPT_RECORD:
+            config->record_path = optarg;
+            break;
+        case OPT_REPLAY:
+            config->replay_path = optarg;
+            break;
+        case OPT_REPLAY_FAST:
+            config->replay_fast = true;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            *exit_code = 0;
+            return false;
+        default:
+            print_usage(argv[0]);
+            *exit_code = 1;
+            return false;
+        }
+    }
+
+    return true;
+}
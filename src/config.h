@@ -0,0 +1,46 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+
+#define DEFAULT_MAX_FPS 30
+#define DEFAULT_IDLE_TIMEOUT 5.0
+#define DEFAULT_THEME "circular"
+#define DEFAULT_RENDER_SCALE 1.0f
+// Scales never go below this fraction of the surface size per axis
+#define RENDER_SCALE_MIN 0.25f
+#define DEFAULT_BARS_PER_CHANNEL 8
+#define DEFAULT_LOW_CUT_OFF 50
+#define DEFAULT_HIGH_CUT_OFF 8000
+#define DEFAULT_NOISE_REDUCTION 0.77
+
+// What the analysis is built from; all of it can also be changed at runtime through the control socket
+typedef struct
+{
+    int bars_per_channel;
+    int low_cut_off;        // Hz
+    int high_cut_off;       // Hz
+    double noise_reduction; // cava's smoothing, from 0 (fast and noisy) to 1 (slow and smooth)
+} AnalysisSettings;
+
+typedef struct
+{
+    const char *theme;   // Name of a built-in theme
+    AnalysisSettings analysis;
+    int max_fps;         // Upper bound on the render rate; 0 follows the output's refresh rate
+    double idle_timeout; // Seconds of silence before rendering and analysis suspend; 0 disables idling
+    bool generate_wisdom; // Measure FFTW plans for every supported FFT size into the cache, then exit
+    bool publish;         // Share the bars with other processes through a shared memory segment
+    const char *publish_name; // Segment name for `publish`, NULL for the per-user default
+    float render_scale;       // Fraction of the surface size to draw at, per axis; the governor's starting point
+    double gpu_budget;        // GPU milliseconds a monitor's draw may take before its scale drops; 0 disables this
+    const char *record_path;  // Capture file receiving the input blocks and analysis frames, NULL to not record
+    const char *replay_path;  // Capture file played instead of the live source, NULL for live audio
+    bool replay_fast;         // Replay as fast as the analysis drains the input instead of at the recorded pace
+} Config;
+
+// Fills `config` with defaults and applies the command line on top. Returns false if ywp should exit
+// (bad arguments or --help); `exit_code` is set accordingly.
+bool parse_config(Config *config, int argc, char **argv, int *exit_code);
+
+#endif // CONFIG_H
@@ -0,0 +1,239 @@
+#include "control.h"
+#include "metrics.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DEFAULT_TRACE_SECONDS 5.0
+#define MAX_TRACE_SECONDS 60.0
+// A client gets this long to send its command line before it is dropped
+#define CLIENT_TIMEOUT_MS 1000
+
+void control_block_signals(void)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
+// Reads one command line from the client. Returns false if it hung up or timed out first.
+static bool read_command(int fd, char *line, size_t size)
+{
+    size_t length = 0;
+    while (length + 1 < size)
+    {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, CLIENT_TIMEOUT_MS) <= 0)
+            return false;
+        ssize_t got = read(fd, line + length, size - 1 - length);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break; // EOF ends the command as well
+        length += (size_t)got;
+        if (memchr(line, '\n', length) != NULL)
+            break;
+    }
+    line[length] = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+    return true;
+}
+
+static void start_trace(ControlServer *control, char *arguments, FILE *out)
+{
+    double seconds = DEFAULT_TRACE_SECONDS;
+    char *token = strtok(arguments, " \t");
+    if (token != NULL)
+    {
+        char *end = NULL;
+        seconds = strtod(token, &end);
+        if (end == token || *end != '\0' || seconds <= 0.0 || seconds > MAX_TRACE_SECONDS)
+        {
+            fprintf(out, "trace: seconds must be in (0, %.0f]\n", MAX_TRACE_SECONDS);
+            return;
+        }
+        token = strtok(NULL, " \t");
+    }
+    snprintf(control->trace_path, sizeof(control->trace_path), "%s", token ? token : control->default_trace_path);
+
+    if (!trace_start(seconds))
+    {
+        fprintf(out, "trace: a trace is already being recorded\n");
+        return;
+    }
+    fprintf(out, "tracing for %.1f s into %s\n", seconds, control->trace_path);
+}
+
+// Commands are matched as whole words, so a prefix like "s" or "settingsx" is not mistaken for one
+static bool is_command(const char *token, size_t token_len, const char *command)
+{
+    return token_len == strlen(command) && strncmp(token, command, token_len) == 0;
+}
+
+static void handle_client(ControlServer *control, int fd)
+{
+    char line[512];
+    if (!read_command(fd, line, sizeof(line)))
+        return;
+
+    FILE *out = fdopen(dup(fd), "w");
+    if (out == NULL)
+        return;
+
+    char *arguments = line + strspn(line, " \t");
+    size_t command_len = strcspn(arguments, " \t");
+    char *rest = arguments + command_len + strspn(arguments + command_len, " \t");
+    if (command_len == 0 || is_command(arguments, command_len, "metrics"))
+        metrics_dump(out);
+    else if (is_command(arguments, command_len, "trace"))
+        start_trace(control, rest, out);
+    else if (is_command(arguments, command_len, "set") && control->reconfigurer != NULL)
+        reconfigurer_set(control->reconfigurer, rest, out);
+    else if (is_command(arguments, command_len, "settings") && control->reconfigurer != NULL)
+        reconfigurer_dump(control->reconfigurer, out);
+    else if (is_command(arguments, command_len, "help"))
+        fprintf(out, "commands: metrics | trace [seconds] [path] | set <key> <value>... | settings | help\n");
+    else
+        fprintf(out, "unknown command '%.*s', try help\n", (int)command_len, arguments);
+    fclose(out);
+}
+
+static void *control_thread(void *arg)
+{
+    ControlServer *control = arg;
+    struct pollfd fds[3] = {
+        {.fd = control->stop_fd, .events = POLLIN},
+        {.fd = control->signal_fd, .events = POLLIN},
+        {.fd = control->listen_fd, .events = POLLIN}, // Ignored by poll while negative
+    };
+
+    while (true)
+    {
+        // While a trace records, wake up when its window closes to write it out
+        uint64_t remaining = trace_remaining();
+        int timeout = remaining > 0 ? (int)((remaining + 999999) / 1000000) : -1;
+        int ready = poll(fds, 3, timeout);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (fds[0].revents & POLLIN)
+            break;
+
+        if (trace_remaining() > 0 && trace_finish(control->trace_path, false))
+            fprintf(stderr, "Trace written to %s\n", control->trace_path);
+
+        if (fds[1].revents & POLLIN)
+        {
+            struct signalfd_siginfo info;
+            if (read(control->signal_fd, &info, sizeof(info)) == sizeof(info))
+                metrics_dump(stderr);
+        }
+        if (fds[2].revents & POLLIN)
+        {
+            int client = accept(control->listen_fd, NULL, NULL);
+            if (client >= 0)
+            {
+                handle_client(control, client);
+                close(client);
+            }
+        }
+    }
+
+    // A trace cut short by shutdown is still worth keeping
+    if (trace_remaining() > 0 && trace_finish(control->trace_path, true))
+        fprintf(stderr, "Trace written to %s\n", control->trace_path);
+    return NULL;
+}
+
+// Binds the control socket, unless a live instance answers on it; a socket nobody answers on is stale
+static int open_socket(ControlServer *control)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", control->socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+    {
+        printf("Another ywp already listens on %s, metrics socket disabled\n", control->socket_path);
+        close(fd);
+        return -1;
+    }
+    unlink(control->socket_path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 4) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool control_start(ControlServer *control, const char *runtime_dir, Reconfigurer *reconfigurer)
+{
+    memset(control, 0, sizeof(*control));
+    control->listen_fd = -1;
+    control->reconfigurer = reconfigurer;
+
+    if (runtime_dir != NULL)
+    {
+        int written = snprintf(control->socket_path, sizeof(control->socket_path), "%s/ywp.sock", runtime_dir);
+        snprintf(control->default_trace_path, sizeof(control->default_trace_path), "%s/ywp-trace.json",
+                 runtime_dir);
+        if (written > 0 && (size_t)written < sizeof(control->socket_path))
+            control->listen_fd = open_socket(control);
+    }
+    if (control->default_trace_path[0] == '\0')
+        snprintf(control->default_trace_path, sizeof(control->default_trace_path), "/tmp/ywp-trace-%d.json",
+                 (int)getpid());
+    if (control->listen_fd < 0)
+        control->socket_path[0] = '\0';
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    control->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    control->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (control->signal_fd < 0 || control->stop_fd < 0 ||
+        pthread_create(&control->thread, NULL, control_thread, control) != 0)
+    {
+        if (control->signal_fd >= 0)
+            close(control->signal_fd);
+        if (control->stop_fd >= 0)
+            close(control->stop_fd);
+        if (control->listen_fd >= 0)
+        {
+            close(control->listen_fd);
+            unlink(control->socket_path);
+        }
+        return false;
+    }
+    return true;
+}
+
+void control_stop(ControlServer *control)
+{
+    uint64_t one = 1;
+    if (write(control->stop_fd, &one, sizeof(one)) < 0)
+    {
+        // Only fails if the counter is saturated, in which case the thread is woken anyway
+    }
+    pthread_join(control->thread, NULL);
+
+    close(control->signal_fd);
+    close(control->stop_fd);
+    if (control->listen_fd >= 0)
+    {
+        close(control->listen_fd);
+        unlink(control->socket_path);
+    }
+}
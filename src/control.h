@@ -0,0 +1,36 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "reconfigure.h"
+
+// Answers requests for the metrics (see metrics.h) and live settings changes (see reconfigure.h) on its own
+// thread, so the render loop never blocks on a client. Requests come from two places:
+//  - a Unix socket taking one line per connection: `metrics` (or an empty line), `trace [seconds] [path]`,
+//    `set <key> <value>...`, `settings` or `help`; the reply is written back and the connection closed
+//  - SIGUSR1, which dumps the metrics to stderr
+typedef struct
+{
+    pthread_t thread;
+    int listen_fd; // -1 when running without a socket
+    int signal_fd;
+    int stop_fd;
+    char socket_path[108]; // sizeof(sockaddr_un.sun_path)
+    char trace_path[PATH_MAX]; // Destination of the trace being recorded
+    char default_trace_path[PATH_MAX];
+    Reconfigurer *reconfigurer; // Serves `set` and `settings`, NULL to refuse them
+} ControlServer;
+
+// Blocks SIGUSR1 so it is only ever delivered through the control thread's signalfd. Call before any other
+// thread is created, since they inherit the mask.
+void control_block_signals(void);
+
+// Listens on `runtime_dir`/ywp.sock unless `runtime_dir` is NULL or another instance already owns the socket.
+// `reconfigurer` may be NULL. Returns false only if the thread cannot be started.
+bool control_start(ControlServer *control, const char *runtime_dir, Reconfigurer *reconfigurer);
+void control_stop(ControlServer *control);
+
+#endif // CONTROL_H
@@ -0,0 +1,242 @@
+#include "damage.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// INNER_CIRCLE_RADIUS and OUTER_CIRCLE_RADIUS of shaders/circular.vert, in half the largest centred square
+#define RING_INNER_RADIUS 0.3f
+#define RING_OUTER_RADIUS 0.9f
+// A Catmull-Rom segment stays within 1.25 times its largest control point (the weights' absolute sum at t = 0.5)
+#define CURVE_OVERSHOOT 1.25f
+
+static const DamageRect full_rect = {0.0f, 0.0f, 1.0f, 1.0f};
+static const DamageRect empty_rect = {0.0f, 0.0f, 0.0f, 0.0f};
+
+static bool has_extension(const char *extensions, const char *name)
+{
+    size_t length = strlen(name);
+    for (const char *found = strstr(extensions, name); found; found = strstr(found + length, name))
+    {
+        bool starts = found == extensions || found[-1] == ' ';
+        bool ends = found[length] == '\0' || found[length] == ' ';
+        if (starts && ends)
+            return true;
+    }
+    return false;
+}
+
+bool damage_tracker_init(DamageTracker *tracker, DamageShape shape, int num_bars)
+{
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->shape = shape;
+    tracker->num_bars = num_bars;
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        tracker->tracks[i].bars = calloc(num_bars, sizeof(float));
+        if (tracker->tracks[i].bars == NULL)
+        {
+            damage_tracker_destroy(tracker);
+            return false;
+        }
+    }
+
+    const char *extensions = eglQueryString(platform.egl.device, EGL_EXTENSIONS);
+    if (extensions == NULL)
+        return true;
+    tracker->buffer_age = has_extension(extensions, "EGL_EXT_buffer_age");
+    if (has_extension(extensions, "EGL_KHR_swap_buffers_with_damage"))
+        tracker->swap_with_damage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    else if (has_extension(extensions, "EGL_EXT_swap_buffers_with_damage"))
+        tracker->swap_with_damage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    return true;
+}
+
+void damage_tracker_destroy(DamageTracker *tracker)
+{
+    for (int i = 0; i < MAX_MONITORS; i++)
+        free(tracker->tracks[i].bars);
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+void damage_tracker_reset(DamageTracker *tracker, DamageShape shape)
+{
+    tracker->shape = shape;
+    for (int i = 0; i < MAX_MONITORS; i++)
+        tracker->tracks[i].history_count = 0;
+}
+
+bool damage_tracker_resize(DamageTracker *tracker, int num_bars)
+{
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        float *bars = realloc(tracker->tracks[i].bars, num_bars * sizeof(float));
+        if (bars == NULL)
+            return false;
+        tracker->tracks[i].bars = bars;
+        tracker->tracks[i].history_count = 0;
+    }
+    tracker->num_bars = num_bars;
+    return true;
+}
+
+static bool rect_empty(DamageRect rect)
+{
+    return rect.x0 >= rect.x1 || rect.y0 >= rect.y1;
+}
+
+static DamageRect rect_union(DamageRect a, DamageRect b)
+{
+    if (rect_empty(a))
+        return b;
+    if (rect_empty(b))
+        return a;
+    return (DamageRect){fminf(a.x0, b.x0), fminf(a.y0, b.y0), fmaxf(a.x1, b.x1), fmaxf(a.y1, b.y1)};
+}
+
+static float clamp_unit(float value)
+{
+    return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+// Bounding square of the wedges whose bar changed, at the larger of both lengths. The last bar is never read:
+// that instance draws the static centre disc.
+static DamageRect ring_damage(const DamageTracker *tracker, const float *previous, const float *bars, int width,
+                              int height)
+{
+    float reach = -1.0f;
+    for (int i = 0; i < tracker->num_bars - 1; i++)
+    {
+        if (previous[i] != bars[i])
+            reach = fmaxf(reach, fmaxf(clamp_unit(previous[i]), clamp_unit(bars[i])));
+    }
+    if (reach < 0.0f)
+        return empty_rect;
+
+    float radius = (RING_INNER_RADIUS + reach * (RING_OUTER_RADIUS - RING_INNER_RADIUS)) *
+                   (float)(width < height ? width : height) / 2.0f;
+    float half_width = radius / (float)width;
+    float half_height = radius / (float)height;
+    return (DamageRect){0.5f - half_width, 0.5f - half_height, 0.5f + half_width, 0.5f + half_height};
+}
+
+// A bar moves the four curve segments whose control points include it; the curve never rises above the
+// overshoot bound of the tallest bar of either frame
+static DamageRect curve_damage(const DamageTracker *tracker, const float *previous, const float *bars)
+{
+    int segments = tracker->num_bars - 1;
+    if (segments < 1)
+        return full_rect;
+
+    int first = -1;
+    int last = -1;
+    float peak = 0.0f;
+    for (int i = 0; i < tracker->num_bars; i++)
+    {
+        if (previous[i] != bars[i])
+        {
+            if (first < 0)
+                first = i;
+            last = i;
+        }
+        peak = fmaxf(peak, fmaxf(previous[i], bars[i]));
+    }
+    if (first < 0)
+        return empty_rect;
+
+    return (DamageRect){clamp_unit((float)(first - 2) / (float)segments), 0.0f,
+                        clamp_unit((float)(last + 2) / (float)segments), clamp_unit(CURVE_OVERSHOOT * peak)};
+}
+
+FrameDamage damage_tracker_begin(DamageTracker *tracker, const MonitorData *monitor, const float *bars, float scale)
+{
+    DamageTrack *track = &tracker->tracks[monitor - platform.monitors];
+    if (track->output_name != monitor->name || track->width != monitor->surface_width ||
+        track->height != monitor->surface_height || track->scale != scale)
+    {
+        track->output_name = monitor->name;
+        track->width = monitor->surface_width;
+        track->height = monitor->surface_height;
+        track->scale = scale;
+        track->history_count = 0;
+    }
+
+    DamageRect changed = full_rect;
+    if (track->history_count > 0)
+    {
+        switch (tracker->shape)
+        {
+        case DAMAGE_FULL:
+            break;
+        case DAMAGE_RING:
+            changed = ring_damage(tracker, track->bars, bars, track->width, track->height);
+            break;
+        case DAMAGE_CURVE:
+            changed = curve_damage(tracker, track->bars, bars);
+            break;
+        }
+    }
+    memcpy(track->bars, bars, tracker->num_bars * sizeof(float));
+
+    memmove(&track->history[1], &track->history[0], (DAMAGE_HISTORY - 1) * sizeof(DamageRect));
+    track->history[0] = changed;
+    if (track->history_count < DAMAGE_HISTORY)
+        track->history_count++;
+
+    // A buffer of age n last held the frame n swaps ago, so it lacks what the latest n frames changed
+    EGLint age = 0;
+    if (tracker->buffer_age &&
+        !eglQuerySurface(platform.egl.device, monitor->egl_surface, EGL_BUFFER_AGE_EXT, &age))
+        age = 0;
+
+    FrameDamage damage = {changed, full_rect};
+    if (age > 0 && age <= track->history_count)
+    {
+        damage.repaint = empty_rect;
+        for (int i = 0; i < age; i++)
+            damage.repaint = rect_union(damage.repaint, track->history[i]);
+    }
+    return damage;
+}
+
+bool damage_tracker_swap(DamageTracker *tracker, const MonitorData *monitor, const FrameDamage *damage)
+{
+    const DamageTrack *track = &tracker->tracks[monitor - platform.monitors];
+    if (tracker->swap_with_damage == NULL)
+        return eglSwapBuffers(platform.egl.device, monitor->egl_surface) != EGL_FALSE;
+
+    // Zero rectangles would mean the whole surface; an unchanged frame reports one empty rectangle instead
+    EGLint box[4];
+    int pixels[4];
+    damage_box(damage->changed, track->width, track->height, damage_margin(track->scale), pixels);
+    for (int i = 0; i < 4; i++)
+        box[i] = pixels[i];
+    return tracker->swap_with_damage(platform.egl.device, monitor->egl_surface, box, 1) != EGL_FALSE;
+}
+
+void damage_box(DamageRect rect, int width, int height, int margin, int box[4])
+{
+    int x0 = (int)floorf(rect.x0 * (float)width) - margin;
+    int y0 = (int)floorf(rect.y0 * (float)height) - margin;
+    int x1 = (int)ceilf(rect.x1 * (float)width) + margin;
+    int y1 = (int)ceilf(rect.y1 * (float)height) + margin;
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > width ? width : x1;
+    y1 = y1 > height ? height : y1;
+    if (rect_empty(rect) || x0 >= x1 || y0 >= y1)
+    {
+        box[0] = box[1] = box[2] = box[3] = 0;
+        return;
+    }
+    box[0] = x0;
+    box[1] = y0;
+    box[2] = x1 - x0;
+    box[3] = y1 - y0;
+}
+
+int damage_margin(float scale)
+{
+    return (int)ceilf(1.0f / scale) + 1;
+}
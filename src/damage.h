@@ -0,0 +1,73 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+#include "theme.h"
+
+// Frames of damage remembered per output; a back buffer older than this is repainted whole
+#define DAMAGE_HISTORY 4
+
+// Part of a frame as fractions of the surface, bottom-left origin like GL; empty when x0 >= x1 or y0 >= y1.
+// Fractions survive a render scale change, pixels would not.
+typedef struct
+{
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+} DamageRect;
+
+typedef struct
+{
+    DamageRect changed; // What differs from the output's previous frame, reported to the compositor
+    DamageRect repaint; // What the back buffer lacks: `changed` plus everything the frames it missed changed
+} FrameDamage;
+
+// Per-output state, indexed like platform.monitors
+typedef struct
+{
+    uint32_t output_name; // Registry name of the output this slot was set up for, 0 while unused
+    // What the output's last frame was drawn at and with; any change of size or scale repaints everything
+    int width;
+    int height;
+    float scale;
+    float *bars;
+    DamageRect history[DAMAGE_HISTORY]; // `changed` of the latest frames, most recent first
+    int history_count;
+} DamageTrack;
+
+// Works out which part of each output a frame changes from the bars it was drawn with, so that only that part
+// is redrawn (as far as the back buffer's age allows) and the compositor only recomposites that part.
+typedef struct
+{
+    DamageShape shape;
+    int num_bars;
+    bool buffer_age;                                     // EGL_EXT_buffer_age, otherwise every frame repaints all
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_with_damage; // NULL without the extension: plain eglSwapBuffers
+    DamageTrack tracks[MAX_MONITORS];
+} DamageTracker;
+
+bool damage_tracker_init(DamageTracker *tracker, DamageShape shape, int num_bars);
+void damage_tracker_destroy(DamageTracker *tracker);
+// Forgets every output's previous frame, e.g. after the program was relinked, so the next frames repaint all
+void damage_tracker_reset(DamageTracker *tracker, DamageShape shape);
+// Follows a change in the number of bars; like a reset, the next frames repaint all
+bool damage_tracker_resize(DamageTracker *tracker, int num_bars);
+
+// Call with the monitor current, right before drawing `bars` on it at `scale`
+FrameDamage damage_tracker_begin(DamageTracker *tracker, const MonitorData *monitor, const float *bars, float scale);
+// Swaps the monitor's surface, reporting `damage->changed` where the driver supports it
+bool damage_tracker_swap(DamageTracker *tracker, const MonitorData *monitor, const FrameDamage *damage);
+
+// Converts `rect` to a pixel box {x, y, width, height} of a width x height target, grown by `margin` pixels to
+// cover rasterization and filtering at its edges; an empty rect gives an empty box
+void damage_box(DamageRect rect, int width, int height, int margin, int box[4]);
+// Surface pixels around a damaged area that a frame drawn at `scale` and stretched over the surface can touch
+int damage_margin(float scale);
+
+#endif // DAMAGE_H
@@ -0,0 +1,310 @@
+#include "dsp.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BAR_SLOT_FRESH 0x4u
+#define BAR_SLOT_MASK 0x3u
+
+// Bars below this are invisible, so the smoothing filters are considered settled
+#define IDLE_BAR_EPSILON 1e-3
+
+static void timespec_add_ns(struct timespec *ts, long ns)
+{
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+static bool timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// `idle` marks the final zero frame before the worker parks, for readers of the shared segment
+static void publish_bars(DspData *dsp, bool idle)
+{
+    BarExchange *bars = &dsp->bars;
+    if (dsp->publisher != NULL)
+        bar_publisher_write(dsp->publisher, bars->slots[bars->back], idle ? YWP_BARS_IDLE : 0);
+    if (dsp->capture != NULL)
+        cava_capture_write_bars(dsp->capture, bars->slots[bars->back], dsp->num_bars);
+
+    unsigned int previous =
+        atomic_exchange_explicit(&bars->middle, bars->back | BAR_SLOT_FRESH, memory_order_acq_rel);
+    bars->back = previous & BAR_SLOT_MASK;
+}
+
+// Runs the analysis on the freshly read samples and stages the bars in the back slot
+static void analyze(DspData *dsp, int new_samples)
+{
+    cava_execute(dsp->cava_in, new_samples, dsp->cava_out, dsp->plan);
+
+    float *bars = dsp->bars.slots[dsp->bars.back];
+    for (int i = 0; i < dsp->num_bars; i++)
+        bars[i] = (float)dsp->cava_out[i];
+}
+
+static double timespec_to_seconds(const struct timespec *ts)
+{
+    return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+static bool samples_silent(const cava_real *samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (samples[i] != 0.0)
+            return false;
+    }
+    return true;
+}
+
+static bool bars_settled(const float *bars, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (bars[i] > IDLE_BAR_EPSILON)
+            return false;
+    }
+    return true;
+}
+
+// Parks the worker until non-silent audio shows up. Silent blocks are drained without touching FFTW,
+// so a quiet desktop costs one wakeup per audio block and nothing else.
+static void wait_while_silent(DspData *dsp)
+{
+    // Publish an exact zero frame so the last picture is clean, then let the render loop settle
+    memset(dsp->bars.slots[dsp->bars.back], 0, sizeof(float) * dsp->num_bars);
+    publish_bars(dsp, true);
+    atomic_store(&dsp->idle, true);
+    uint64_t idle_start = metrics_now();
+
+    while (atomic_load_explicit(&dsp->running, memory_order_relaxed))
+    {
+        wait_for_cava_input(&dsp->audio->ring);
+        int new_samples = read_from_cava_input_buffers(dsp->audio, dsp->cava_in, dsp->audio->cava_buffer_size);
+        if (!samples_silent(dsp->cava_in, new_samples))
+        {
+            // Feed the block we just woke up for, it is the start of the sound
+            analyze(dsp, new_samples);
+            publish_bars(dsp, false);
+            break;
+        }
+    }
+
+    atomic_store(&dsp->idle, false);
+    atomic_fetch_add_explicit(&metrics.idle_ns, metrics_now() - idle_start, memory_order_relaxed);
+    uint64_t one = 1;
+    if (write(dsp->wake_fd, &one, sizeof(one)) < 0)
+    {
+        // Counter saturated; the render loop is awake anyway
+    }
+}
+
+bool dsp_process(DspData *dsp)
+{
+    uint64_t start = metrics_now();
+    int new_samples = read_from_cava_input_buffers(dsp->audio, dsp->cava_in, dsp->audio->cava_buffer_size);
+    analyze(dsp, new_samples);
+    metrics_span(METRIC_DSP, start);
+    metrics_record(METRIC_SAMPLES, (uint64_t)new_samples);
+    atomic_store_explicit(&metrics.overruns, atomic_load_explicit(&dsp->audio->ring.overruns, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&metrics.cava_framerate, (uint64_t)(dsp->plan->framerate * 1e3), memory_order_relaxed);
+    bool settled = bars_settled(dsp->bars.slots[dsp->bars.back], dsp->num_bars);
+    publish_bars(dsp, false);
+    return !samples_silent(dsp->cava_in, new_samples) || !settled;
+}
+
+static void *dsp_thread(void *arg)
+{
+    DspData *dsp = arg;
+    const long period_ns = (long)(1e9 / dsp->rate);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double last_sound = timespec_to_seconds(&next);
+
+    while (atomic_load_explicit(&dsp->running, memory_order_relaxed))
+    {
+        if (dsp_process(dsp))
+            last_sound = timespec_to_seconds(&next);
+        else if (dsp->idle_timeout > 0.0 && timespec_to_seconds(&next) - last_sound >= dsp->idle_timeout)
+        {
+            wait_while_silent(dsp);
+            clock_gettime(CLOCK_MONOTONIC, &next);
+            last_sound = timespec_to_seconds(&next);
+            continue;
+        }
+
+        // Sleep until the next tick; if we fell behind, restart the cadence instead of bursting to catch up
+        timespec_add_ns(&next, period_ns);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&next, &now))
+        {
+            next = now;
+            continue;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    return NULL;
+}
+
+bool dsp_init(DspData *dsp, struct audio_data *audio, struct cava_plan *plan, double rate, double idle_timeout)
+{
+    dsp->audio = audio;
+    dsp->plan = plan;
+    dsp->num_bars = plan->number_of_bars * plan->audio_channels;
+    dsp->rate = rate;
+    dsp->idle_timeout = idle_timeout;
+    dsp->publisher = NULL;
+    dsp->capture = NULL;
+
+    dsp->cava_in = malloc(sizeof(cava_real) * audio->cava_buffer_size);
+    dsp->cava_out = calloc(dsp->num_bars, sizeof(cava_real));
+    if (dsp->cava_in == NULL || dsp->cava_out == NULL)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        dsp->bars.slots[i] = calloc(dsp->num_bars, sizeof(float));
+        if (dsp->bars.slots[i] == NULL)
+            return false;
+    }
+    dsp->bars.back = 0;
+    dsp->bars.front = 1;
+    atomic_init(&dsp->bars.middle, 2);
+
+    dsp->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dsp->wake_fd < 0)
+        return false;
+    atomic_init(&dsp->idle, false);
+    atomic_init(&dsp->running, false);
+    return true;
+}
+
+bool dsp_start(DspData *dsp)
+{
+    atomic_store(&dsp->running, true);
+    if (pthread_create(&dsp->thread, NULL, dsp_thread, dsp) != 0)
+    {
+        printf("Error creating DSP thread\n");
+        return false;
+    }
+    return true;
+}
+
+void dsp_stop(DspData *dsp)
+{
+    atomic_store(&dsp->running, false);
+    wake_cava_input_reader(&dsp->audio->ring);
+    pthread_join(dsp->thread, NULL);
+}
+
+// Resamples a frame of `old_bars` onto `num_bars`, nearest bar by position within each channel, so the bars on
+// screen do not jump when their number changes
+static void resample_bars(float *to, int num_bars, const float *from, int old_bars, int channels)
+{
+    int per_channel = num_bars / channels;
+    int old_per_channel = old_bars / channels;
+    for (int i = 0; i < num_bars; i++)
+    {
+        int channel = i / per_channel;
+        int bar = (int)((long)(i % per_channel) * old_per_channel / per_channel);
+        to[i] = from[channel * old_per_channel + bar];
+    }
+}
+
+struct cava_plan *dsp_set_plan(DspData *dsp, struct cava_plan *plan)
+{
+    int num_bars = plan->number_of_bars * plan->audio_channels;
+    if (num_bars != dsp->num_bars)
+    {
+        // Allocate everything before touching anything, so a failure leaves the old plan fully working
+        cava_real *cava_out = calloc(num_bars, sizeof(cava_real));
+        float *slots[3] = {NULL, NULL, NULL};
+        bool allocated = cava_out != NULL;
+        for (int i = 0; i < 3; i++)
+        {
+            slots[i] = malloc(sizeof(float) * num_bars);
+            allocated = allocated && slots[i] != NULL;
+        }
+        if (!allocated)
+        {
+            free(cava_out);
+            for (int i = 0; i < 3; i++)
+                free(slots[i]);
+            return NULL;
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            resample_bars(slots[i], num_bars, dsp->bars.slots[i], dsp->num_bars, plan->audio_channels);
+            free(dsp->bars.slots[i]);
+            dsp->bars.slots[i] = slots[i];
+        }
+        free(dsp->cava_out);
+        dsp->cava_out = cava_out;
+        dsp->num_bars = num_bars;
+
+        if (dsp->publisher != NULL && !bar_publisher_resize(dsp->publisher, num_bars))
+        {
+            printf("Could not resize the shared bars, stopped publishing\n");
+            dsp->publisher = NULL;
+        }
+    }
+
+    cava_carry_state(plan, dsp->plan);
+    struct cava_plan *previous = dsp->plan;
+    dsp->plan = plan;
+    return previous;
+}
+
+void dsp_destroy(DspData *dsp)
+{
+    close(dsp->wake_fd);
+    for (int i = 0; i < 3; i++)
+        free(dsp->bars.slots[i]);
+    free(dsp->cava_in);
+    free(dsp->cava_out);
+}
+
+const float *dsp_acquire_bars(DspData *dsp, bool *fresh)
+{
+    BarExchange *bars = &dsp->bars;
+    bool has_new = atomic_load_explicit(&bars->middle, memory_order_relaxed) & BAR_SLOT_FRESH;
+    if (has_new)
+    {
+        unsigned int previous = atomic_exchange_explicit(&bars->middle, bars->front, memory_order_acq_rel);
+        bars->front = previous & BAR_SLOT_MASK;
+    }
+    if (fresh)
+        *fresh = has_new;
+    return bars->slots[bars->front];
+}
+
+bool dsp_settled(DspData *dsp)
+{
+    if (!atomic_load(&dsp->idle))
+        return false;
+    return !(atomic_load(&dsp->bars.middle) & BAR_SLOT_FRESH);
+}
+
+void dsp_clear_wake(DspData *dsp)
+{
+    uint64_t count;
+    if (read(dsp->wake_fd, &count, sizeof(count)) < 0)
+    {
+        // Nothing pending
+    }
+}
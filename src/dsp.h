@@ -0,0 +1,69 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "bar_publisher.h"
+#include "capture.h"
+#include "cavacore.h"
+#include "input_methods.h"
+
+// Triple buffer of bar snapshots. The DSP worker always owns `back`, the render loop owns `front`
+// and the remaining slot holds the most recently published frame. Neither side ever waits.
+typedef struct
+{
+    float *slots[3];
+    _Atomic unsigned int middle; // Index of the published slot, ORed with BAR_SLOT_FRESH when unread
+    unsigned int back;           // Owned by the DSP worker
+    unsigned int front;          // Owned by the render loop
+} BarExchange;
+
+typedef struct
+{
+    struct audio_data *audio;
+    struct cava_plan *plan;
+    int num_bars; // Bars per channel * channels
+    double rate;  // Analysis cadence in Hz, independent of the display refresh
+    double idle_timeout; // Seconds of silence before the pipeline suspends, 0 never suspends
+    BarPublisher *publisher; // Optional, every published frame is also shared here; set before dsp_start
+    struct cava_capture *capture; // Optional, every published frame is also recorded here; set before dsp_start
+
+    pthread_t thread;
+    atomic_bool running;
+    cava_real *cava_in;
+    cava_real *cava_out; // cava_execute output, narrowed to float when published for the shaders
+    BarExchange bars;
+
+    atomic_bool idle; // Set once the final (all zero) frame is published and FFT work is suspended
+    int wake_fd;      // eventfd signalled when the worker leaves idle, for a sleeping render loop
+} DspData;
+
+bool dsp_init(DspData *dsp, struct audio_data *audio, struct cava_plan *plan, double rate, double idle_timeout);
+void dsp_destroy(DspData *dsp);
+
+// Spawns the DSP worker: it calls dsp_process every 1/rate seconds and idles on silence
+bool dsp_start(DspData *dsp);
+void dsp_stop(DspData *dsp);
+
+// Replaces the analysis plan, which may have another number of bars, while the worker is stopped. The bars and
+// cava's filters carry over resampled, so the picture continues where it was. Returns the previous plan for the
+// caller to destroy, or NULL if the buffers cannot be resized and nothing changed.
+struct cava_plan *dsp_set_plan(DspData *dsp, struct cava_plan *plan);
+
+// One analysis step on the calling thread: drains the input ring, runs cava_execute and publishes the bars.
+// Returns false when the block was silent and the bars have settled.
+bool dsp_process(DspData *dsp);
+
+// Returns the latest published bars; `fresh` (optional) tells whether they changed since the last call.
+// The pointer stays valid until the next call from the same thread.
+const float *dsp_acquire_bars(DspData *dsp, bool *fresh);
+
+// True once the worker went idle and the render loop already holds its final frame, i.e. nothing will change
+// on screen until `wake_fd` fires
+bool dsp_settled(DspData *dsp);
+// Consumes a pending `wake_fd` notification
+void dsp_clear_wake(DspData *dsp);
+
+#endif // DSP_H
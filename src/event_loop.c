@@ -0,0 +1,125 @@
+#include "event_loop.h"
+#include "platform.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// More than the number of sources, so one epoll_wait sees all of them
+#define MAX_EVENTS 8
+
+static bool watch_fd(EventLoop *loop, int fd, uint32_t tag)
+{
+    struct epoll_event event = {.events = EPOLLIN, .data.u32 = tag};
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool event_loop_init(EventLoop *loop, int wake_fd)
+{
+    loop->wake_fd = wake_fd;
+    loop->deadline = -1.0;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->epoll_fd < 0 || loop->timer_fd < 0)
+    {
+        event_loop_destroy(loop);
+        return false;
+    }
+
+    if (!watch_fd(loop, wl_display_get_fd(platform.display), EVENT_WAYLAND) ||
+        !watch_fd(loop, loop->timer_fd, EVENT_DEADLINE) || (wake_fd >= 0 && !watch_fd(loop, wake_fd, EVENT_WAKE)))
+    {
+        event_loop_destroy(loop);
+        return false;
+    }
+    return true;
+}
+
+bool event_loop_add_fd(EventLoop *loop, int fd, int event)
+{
+    return watch_fd(loop, fd, (uint32_t)event);
+}
+
+void event_loop_destroy(EventLoop *loop)
+{
+    if (loop->timer_fd >= 0)
+        close(loop->timer_fd);
+    if (loop->epoll_fd >= 0)
+        close(loop->epoll_fd);
+    loop->timer_fd = -1;
+    loop->epoll_fd = -1;
+}
+
+void event_loop_set_deadline(EventLoop *loop, double time)
+{
+    if (time == loop->deadline || (time < 0.0 && loop->deadline < 0.0))
+        return;
+
+    // An all-zero it_value disarms the timer; an absolute deadline already in the past fires immediately
+    struct itimerspec spec = {0};
+    if (time >= 0.0)
+    {
+        spec.it_value.tv_sec = (time_t)time;
+        spec.it_value.tv_nsec = (long)((time - (double)spec.it_value.tv_sec) * 1e9);
+    }
+    timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    loop->deadline = time;
+}
+
+int event_loop_wait(EventLoop *loop)
+{
+    // Standard prepare/read dance so events queued by another reader are never lost while we sleep
+    while (wl_display_prepare_read(platform.display) != 0)
+    {
+        if (wl_display_dispatch_pending(platform.display) == -1)
+            return -1;
+    }
+    if (wl_display_flush(platform.display) == -1 && errno != EAGAIN)
+    {
+        wl_display_cancel_read(platform.display);
+        return -1;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, -1);
+    if (count < 0)
+    {
+        wl_display_cancel_read(platform.display);
+        return errno == EINTR ? 0 : -1;
+    }
+
+    int ready = 0;
+    uint32_t display_events = 0;
+    for (int i = 0; i < count; i++)
+    {
+        ready |= (int)events[i].data.u32;
+        if (events[i].data.u32 == EVENT_WAYLAND)
+            display_events = events[i].events;
+    }
+
+    if (display_events & EPOLLIN)
+    {
+        if (wl_display_read_events(platform.display) == -1)
+            return -1;
+    }
+    else
+    {
+        wl_display_cancel_read(platform.display);
+    }
+    if (display_events & (EPOLLERR | EPOLLHUP))
+        return -1;
+    if (wl_display_dispatch_pending(platform.display) == -1)
+        return -1;
+
+    if (ready & EVENT_DEADLINE)
+    {
+        uint64_t expirations;
+        if (read(loop->timer_fd, &expirations, sizeof(expirations)) < 0)
+        {
+            // Re-armed in the meantime, nothing to consume
+        }
+        loop->deadline = -1.0;
+    }
+    return ready;
+}
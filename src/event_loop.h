@@ -0,0 +1,36 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdbool.h>
+
+// Readiness reported by event_loop_wait
+#define EVENT_WAYLAND 0x1 // Wayland events were read and dispatched
+#define EVENT_WAKE 0x2    // The wake eventfd is readable
+#define EVENT_DEADLINE 0x4 // The deadline set with event_loop_set_deadline has passed
+#define EVENT_SHADERS 0x8  // A source added with this flag (the shader watcher) is readable
+#define EVENT_RECONFIGURE 0x10 // A source added with this flag (the reconfigurer) is readable
+
+// The render thread's only blocking point: one epoll set holding the Wayland connection, an eventfd other
+// threads signal and a timerfd for frame deadlines. Nothing in it polls, so the process sleeps until one of
+// them has real work.
+typedef struct
+{
+    int epoll_fd;
+    int timer_fd;
+    int wake_fd;       // Owned by the caller, -1 if unused
+    double deadline;   // Absolute CLOCK_MONOTONIC seconds the timer is armed for, negative when disarmed
+} EventLoop;
+
+bool event_loop_init(EventLoop *loop, int wake_fd);
+void event_loop_destroy(EventLoop *loop);
+// Adds another readable fd, reported as `event` and left for the caller to drain
+bool event_loop_add_fd(EventLoop *loop, int fd, int event);
+
+// Arms the timer for an absolute CLOCK_MONOTONIC time in seconds; a negative time disarms it
+void event_loop_set_deadline(EventLoop *loop, double time);
+// Flushes pending requests and blocks until at least one source is ready. Wayland events are dispatched
+// before returning; the wake eventfd is left for the caller to drain. Returns a mask of EVENT_* flags, or -1
+// once the Wayland connection is gone.
+int event_loop_wait(EventLoop *loop);
+
+#endif // EVENT_LOOP_H
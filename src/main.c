@@ -1,143 +1,485 @@
 #include <assert.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "bar_buffer.h"
+#include "bar_history.h"
+#include "capture.h"
 #include "cavacore.h"
+#include "config.h"
+#include "control.h"
+#include "damage.h"
+#include "dsp.h"
+#include "event_loop.h"
 #include "input_methods.h"
+#include "metrics.h"
+#include "paths.h"
 #include "platform.h"
-#include "shader.h"
+#include "program_cache.h"
+#include "reconfigure.h"
+#include "render_scale.h"
+#include "renderer.h"
+#include "shader_watcher.h"
 
-#define TARGET_FPS 30
+#define ANALYSIS_RATE 60
 
-float get_monotonic_time()
+double get_monotonic_time()
 {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (float)ts.tv_sec + (float)ts.tv_nsec / 1e9f;
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Shortest time between two frames we are allowed to start on a monitor refreshing at `refresh` mHz. Frame
+// callbacks already pace us to the refresh rate, so this only matters when max_fps is below it. Half a refresh
+// period of slack keeps us from waking just after a vblank and losing a whole extra refresh.
+double min_frame_interval(int max_fps, int refresh)
+{
+    if (max_fps <= 0)
+        return 0.0;
+
+    double interval = 1.0 / max_fps;
+    if (refresh > 0)
+        interval -= 0.5 * 1000.0 / refresh;
+    return interval > 0.0 ? interval : 0.0;
+}
+
+// Plans every FFT size cava_init can pick for the sample rates backends deliver, with FFTW_PATIENT, and stores
+// the wisdom in the cache so later launches skip planning altogether. That covers mono and stereo and every bass
+// decimation, so any bar count and cut-offs, at startup or through `set`, plan from the cache too.
+int generate_wisdom(const char *cache_dir)
+{
+    static const unsigned int rates[] = {44100, 96000, 192000};
+
+    if (cache_dir == NULL)
+    {
+        printf("Error: no cache directory ($XDG_CACHE_HOME or $HOME) to store FFTW wisdom in\n");
+        return 1;
+    }
+    cava_set_wisdom_dir(cache_dir, FFTW_PATIENT);
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        double start = get_monotonic_time();
+        if (cava_generate_wisdom(rates[i]) != 0)
+        {
+            printf("Error planning for %u Hz\n", rates[i]);
+            return 1;
+        }
+        printf("%u Hz: %.1f s\n", rates[i], get_monotonic_time() - start);
+    }
+
+    char path[PATH_MAX];
+    cava_wisdom_path(path, sizeof(path));
+    printf("Stored in %s\n", path);
+    return 0;
+}
+
+// True while a monitor that is free to draw has not shown the bars published at `bars_time` yet. Monitors
+// waiting on a frame event are left out; they catch up once the compositor shows them again.
+bool monitors_behind(double bars_time)
+{
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        const MonitorData *monitor = &platform.monitors[i];
+        if (monitor_drawable(monitor) && !frame_pending(monitor) && monitor->last_frame_time < bars_time)
+            return true;
+    }
+    return false;
+}
+
+// Swaps a plan built by the reconfigurer into the DSP worker and resizes everything downstream that holds bars.
+// The worker is only parked for the swap, and the monitors keep showing the last bars (resampled to the new
+// count) until it publishes again. Returns false if the GPU side could not follow.
+bool swap_plan(DspData *dsp, struct cava_plan *plan, Reconfigurer *reconfigurer, BarBuffer *bar_buffer,
+               BarHistory *bar_history, Renderer *renderer, DamageTracker *damage_tracker)
+{
+    dsp_stop(dsp);
+    struct cava_plan *previous = dsp_set_plan(dsp, plan);
+    if (previous == NULL)
+    {
+        printf("Out of memory for %d bars, keeping the current analysis\n", plan->number_of_bars);
+        previous = plan;
+    }
+    reconfigurer_retire(reconfigurer, previous);
+
+    bool resized = bar_buffer_resize(bar_buffer, dsp->num_bars) && bar_history_resize(bar_history, dsp->num_bars) &&
+                   damage_tracker_resize(damage_tracker, dsp->num_bars);
+    renderer_set_num_bars(renderer, dsp->num_bars);
+    return dsp_start(dsp) && resized;
+}
+
+// Makes `name` the drawn theme, with its program from the cache when it was linked before. Keeps the current theme
+// if the new one does not build. `theme_name` holds the name for as long as the theme is in use.
+bool switch_theme(const char *name, char theme_name[NAME_MAX], Theme *theme, const char *shader_dir,
+                  ProgramCache *program_cache, Renderer *renderer, DamageTracker *damage_tracker)
+{
+    Theme next;
+    if (!find_theme(name, shader_dir, &next))
+        return false;
+    GLuint program = program_cache_load_theme(program_cache, &next, shader_dir);
+    if (program == 0)
+        return false;
+
+    snprintf(theme_name, NAME_MAX, "%s", name);
+    *theme = next;
+    theme->name = theme_name;
+    renderer_set_program(renderer, program);
+    damage_tracker_reset(damage_tracker, theme_damage_shape(theme, shader_dir));
+    return true;
 }
 
 int main(int argc, char **argv)
 {
-    init_platform();
+    Config config;
+    int exit_code = 0;
+    if (!parse_config(&config, argc, argv, &exit_code))
+        return exit_code;
+
+    // Before any thread exists, so SIGUSR1 only ever reaches the control thread
+    control_block_signals();
+    metrics_init();
+
+    // FFTW plans are measured once per FFT size and CPU and then come from the cache, which keeps restarts
+    // on login or monitor changes cheap
+    char cache_dir[PATH_MAX];
+    bool have_cache_dir = get_cache_dir(cache_dir, sizeof(cache_dir));
+    if (config.generate_wisdom)
+        return generate_wisdom(have_cache_dir ? cache_dir : NULL);
+    if (have_cache_dir)
+        cava_set_wisdom_dir(cache_dir, FFTW_MEASURE);
+
+    if (!init_platform())
+    {
+        printf("Error connecting to the Wayland compositor\n");
+        return -1;
+    }
 
     struct audio_data audio_data = {0};
     memset(&audio_data, 0, sizeof(struct audio_data));
 
+    // A replay reads its stream format from the capture header, like a backend negotiating one
     pthread_t audio_thread;
-    create_input_thread(&audio_thread, &audio_data, 44100, 16);
-
-    int bars_per_channel = 8;
+    if (config.replay_path != NULL)
+        create_replay_thread(&audio_thread, &audio_data, config.replay_path, !config.replay_fast);
+    else
+        create_input_thread(&audio_thread, &audio_data, 44100, 16);
+    // Backends that negotiate their format (PipeWire) only know the sample rate once the stream is linked
+    if (wait_for_input_params(&audio_data) != 0)
+    {
+        printf("Error starting audio input: %s\n", audio_data.error_message);
+        return -1;
+    }
 
-    struct cava_plan *plan = cava_init(bars_per_channel, audio_data.rate, audio_data.channels, 0, 0.77, 50, 8000);
+    const AnalysisSettings *analysis = &config.analysis;
+    struct cava_plan *plan = cava_init(analysis->bars_per_channel, audio_data.rate, audio_data.channels, 0,
+                                       analysis->noise_reduction, analysis->low_cut_off, analysis->high_cut_off);
     if (plan->status != 0)
     {
         printf("Error initializing cava: %s\n", plan->error_message);
         return -1;
     }
+    int num_bars = analysis->bars_per_channel * audio_data.channels;
+
+    // Files in the shader directory override the built-in sources of a theme, or add fragment-only themes
+    char shader_dir_path[PATH_MAX];
+    const char *shader_dir = get_shader_dir(shader_dir_path, sizeof(shader_dir_path)) ? shader_dir_path : NULL;
+    // Custom themes keep pointing at their name, which has to outlive a switch requested over the control socket
+    char theme_name[NAME_MAX];
+    snprintf(theme_name, sizeof(theme_name), "%s", config.theme);
+    Theme theme;
+    if (!find_theme(theme_name, shader_dir, &theme))
+    {
+        printf("Unknown theme '%s' (available: %s)\n", config.theme, theme_names());
+        return -1;
+    }
+
+    // Linked programs are cached next to the FFTW wisdom, so only the first start after an edit or a driver
+    // update compiles shaders
+    ProgramCache program_cache;
+    program_cache_init(&program_cache, have_cache_dir ? cache_dir : NULL);
+
+    Renderer renderer;
+    GLuint program = program_cache_load_theme(&program_cache, &theme, shader_dir);
+    if (!renderer_init(&renderer, &theme, program, num_bars))
+    {
+        printf("Error creating renderer for theme '%s'\n", theme.name);
+        return -1;
+    }
+
+    // Monitors may draw at a fraction of their resolution; with --gpu-budget the fraction follows the GPU load
+    RenderScaler scaler;
+    if (!render_scaler_init(&scaler, config.render_scale, config.gpu_budget))
+        printf("GPU timer queries are unavailable, rendering at a fixed scale of %.2f\n", config.render_scale);
+
+    // Only the part of a surface the changed bars can reach is redrawn and handed to the compositor as damage
+    DamageTracker damage_tracker;
+    if (!damage_tracker_init(&damage_tracker, theme_damage_shape(&theme, shader_dir), num_bars))
+    {
+        printf("Error creating damage tracker\n");
+        return -1;
+    }
 
-    // char *vertex_source = (char *)shaders_spline_vert;
-    // GLint vertex_len = (GLint)shaders_spline_vert_len;
-    // char *fragment_source = (char *)shaders_spline_frag;
-    // GLint fragment_len = (GLint)shaders_spline_frag_len;
-
-    char *vertex_source = (char *)shaders_circular_vert;
-    GLint vertex_len = (GLint)shaders_circular_vert_len;
-    char *fragment_source = (char *)shaders_circular_frag;
-    GLint fragment_len = (GLint)shaders_circular_frag_len;
-
-    GLuint shader_program = create_shader_program(vertex_source, vertex_len, fragment_source, fragment_len);
-    glUseProgram(shader_program);
-
-    float projection_matrix[16];
-    construct_projection_matrix(projection_matrix, 0.0f, (float)core.window_size.width, 0.0f,
-                                (float)core.window_size.height, -1.0f, 1.0f);
-    GLint proj_location = glGetUniformLocation(shader_program, "u_projection");
-    glUniformMatrix4fv(proj_location, 1, GL_FALSE, projection_matrix);
-
-    GLint viewport_location = glGetUniformLocation(shader_program, "u_viewport");
-    glUniform2f(viewport_location, (float)core.window_size.width, (float)core.window_size.height);
-
-    GLint num_bars_location = glGetUniformLocation(shader_program, "u_num_bars");
-    glUniform1i(num_bars_location, bars_per_channel * audio_data.channels);
-
-    GLint time_location = glGetUniformLocation(shader_program, "u_time");
-
-    // Our spline buffer
-    // We assume that the number of bars per channel is known and fixed so that
-    // we can allocate the buffer once
-    GLuint ssbo;
-    glGenBuffers(1, &ssbo);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(double) * bars_per_channel * audio_data.channels, NULL,
-                 GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-    double *cava_out = (double *)malloc(sizeof(double) * bars_per_channel * audio_data.channels);
-    assert(cava_out != NULL);
-
-    const float frame_time = 1.0f / TARGET_FPS;
-    const float start_time = get_monotonic_time();
-    float last_iteration_time = 0.0f;
-    while (true)
-    {
-        wl_display_dispatch_pending(platform.display);
-        wl_display_flush(platform.display);
-
-        pthread_mutex_lock(&audio_data.lock);
-        cava_execute(audio_data.cava_in, audio_data.samples_counter, cava_out, plan);
-        if (audio_data.samples_counter > 0)
-            audio_data.samples_counter = 0;
-        pthread_mutex_unlock(&audio_data.lock);
-
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        glBegin(GL_QUADS);
-        glVertex2f(0.0f, 0.0f);
-        glVertex2f(core.window_size.width, 0.0f);
-        glVertex2f(core.window_size.width, core.window_size.height);
-        glVertex2f(0.0f, core.window_size.height);
-        glEnd();
-
-        // Update SSBO with cava_out data
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(double) * bars_per_channel * audio_data.channels, cava_out);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-        // Update time uniform
-        float current_time = get_monotonic_time() - start_time;
-        printf("Time: %f\n", current_time);
-        glUniform1f(time_location, current_time);
-
-        eglSwapBuffers(platform.egl.device, platform.egl.surface);
-
-        // We want to run at TARGET_FPS
-        current_time = get_monotonic_time() - start_time;
-        float elapsed_time = current_time - last_iteration_time;
-        if (elapsed_time < frame_time)
+    // Bars are streamed through a small ring of SSBO slots, sized for the bars at startup and only reallocated when
+    // a live change asks for more than fit
+    BarBuffer bar_buffer;
+    if (!bar_buffer_init(&bar_buffer, num_bars))
+    {
+        printf("Error creating bar buffer\n");
+        return -1;
+    }
+
+    // Every fresh frame of bars also becomes one row of the history texture, for themes that look back in time
+    BarHistory bar_history;
+    if (!bar_history_init(&bar_history, num_bars))
+    {
+        printf("Error creating bar history\n");
+        return -1;
+    }
+    renderer.history = &bar_history;
+
+    // Analysis runs on its own thread at ANALYSIS_RATE; we only pick up the latest bars each frame
+    DspData dsp = {0};
+    if (!dsp_init(&dsp, &audio_data, plan, ANALYSIS_RATE, config.idle_timeout))
+    {
+        printf("Error starting DSP worker\n");
+        return -1;
+    }
+
+    // With --publish the worker also writes every frame into shared memory, so widgets can map the bars instead
+    // of running their own capture and FFT
+    BarPublisher publisher;
+    if (config.publish)
+    {
+        if (!bar_publisher_init(&publisher, config.publish_name, dsp.num_bars, audio_data.channels,
+                                audio_data.rate))
+            return -1;
+        dsp.publisher = &publisher;
+    }
+
+    // With --record the input thread appends every block it hands to the ring and the worker every frame, so the
+    // session can be replayed later or fed to ywp-bench
+    struct cava_capture *capture = NULL;
+    if (config.record_path != NULL)
+    {
+        char error[256];
+        capture = cava_capture_create(config.record_path, &audio_data, dsp.num_bars, 0, error, sizeof(error));
+        if (capture == NULL)
         {
-            float time_to_sleep = frame_time - elapsed_time;
-            usleep((useconds_t)(time_to_sleep * 1e6f));
+            printf("Error starting the recording: %s\n", error);
+            return -1;
         }
-        last_iteration_time = current_time;
+        dsp.capture = capture;
+        atomic_store_explicit(&audio_data.capture, capture, memory_order_release);
+    }
+    if (!dsp_start(&dsp))
+    {
+        printf("Error starting DSP worker\n");
+        return -1;
+    }
+
+    // Wayland events, the DSP worker's wakeup and the fps cap deadlines all arrive through one epoll set
+    EventLoop loop;
+    if (!event_loop_init(&loop, dsp.wake_fd))
+    {
+        printf("Error creating the event loop\n");
+        return -1;
     }
+
+    // Saving the theme's files relinks the program on the watcher's thread; we only swap the result in
+    ShaderWatcher watcher;
+    bool watching = shader_dir && shader_watcher_start(&watcher, &theme, shader_dir, &program_cache);
+    if (watching && !event_loop_add_fd(&loop, watcher.ready_fd, EVENT_SHADERS))
+    {
+        shader_watcher_stop(&watcher);
+        watching = false;
+    }
+
+    // `set` requests on the control socket plan on the control thread; only the swap happens here
+    Reconfigurer reconfigurer;
+    if (!reconfigurer_init(&reconfigurer, analysis, theme_name, audio_data.rate, audio_data.channels, shader_dir) ||
+        !event_loop_add_fd(&loop, reconfigurer.ready_fd, EVENT_RECONFIGURE))
+    {
+        printf("Error creating the reconfigurer\n");
+        return -1;
+    }
+
+    // Metrics and settings are served from $XDG_RUNTIME_DIR/ywp.sock, metrics also on SIGUSR1, on a thread of
+    // their own
+    char runtime_dir[PATH_MAX];
+    ControlServer control;
+    if (!control_start(&control, get_runtime_dir(runtime_dir, sizeof(runtime_dir)) ? runtime_dir : NULL,
+                       &reconfigurer))
+    {
+        printf("Error starting the control thread\n");
+        return -1;
+    }
+
+    // Every monitor gets its own surface and is paced by its own frame callbacks, but they all draw from the
+    // same analysis, program and bar buffer
+    const double start_time = get_monotonic_time();
+    double bars_time = start_time;
+    // The bound slot still holds the bars of the last upload; only a resize of the buffer invalidates it
+    bool bars_stale = true;
+    bool running = true;
+    while (running)
+    {
+        // Once the final silent frame is on screen nothing is drawn until the DSP worker hears something again
+        bool idle = dsp_settled(&dsp) && !monitors_behind(bars_time);
+
+        // A monitor is due once the compositor delivered its frame event and its fps cap has elapsed; the
+        // compositor holds frame events back while a monitor's wallpaper is occluded
+        double now = get_monotonic_time();
+        double next_due = -1.0;
+        MonitorData *due[MAX_MONITORS];
+        int due_count = 0;
+        for (int i = 0; !idle && i < MAX_MONITORS; i++)
+        {
+            MonitorData *monitor = &platform.monitors[i];
+            if (!monitor_drawable(monitor) || frame_pending(monitor))
+                continue;
+
+            double due_time = monitor->last_frame_time < 0.0
+                                  ? now
+                                  : monitor->last_frame_time + min_frame_interval(config.max_fps, monitor->refresh);
+            if (due_time <= now)
+                due[due_count++] = monitor;
+            else if (next_due < 0.0 || due_time < next_due)
+                next_due = due_time;
+        }
+
+        if (due_count == 0)
+        {
+            // Sleep until a frame event, the next capped frame or the worker's wakeup, whichever comes first
+            event_loop_set_deadline(&loop, next_due);
+            int events = event_loop_wait(&loop);
+            if (events == -1)
+            {
+                running = false;
+                continue;
+            }
+            if (events & EVENT_WAKE)
+                dsp_clear_wake(&dsp);
+            if (events & EVENT_SHADERS)
+            {
+                GLuint reloaded = shader_watcher_take(&watcher);
+                if (reloaded != 0)
+                {
+                    renderer_set_program(&renderer, reloaded);
+                    damage_tracker_reset(&damage_tracker, theme_damage_shape(&theme, shader_dir));
+                    // Counts as new content, so every monitor redraws even while idle
+                    bars_time = get_monotonic_time();
+                }
+            }
+            if (events & EVENT_RECONFIGURE)
+            {
+                char requested_theme[NAME_MAX];
+                struct cava_plan *next = reconfigurer_take(&reconfigurer, requested_theme, sizeof(requested_theme));
+                if (next != NULL && !swap_plan(&dsp, next, &reconfigurer, &bar_buffer, &bar_history, &renderer,
+                                               &damage_tracker))
+                {
+                    printf("Error resizing the bar buffers\n");
+                    running = false;
+                    continue;
+                }
+                plan = dsp.plan;
+                bars_stale |= next != NULL;
+
+                // The watcher reads the theme, so it is stopped for the switch and restarted on the new theme's files
+                if (requested_theme[0] != '\0')
+                {
+                    if (watching)
+                        shader_watcher_stop(&watcher);
+                    if (!switch_theme(requested_theme, theme_name, &theme, shader_dir, &program_cache, &renderer,
+                                      &damage_tracker))
+                        printf("Theme '%s' does not build, keeping '%s'\n", requested_theme, theme.name);
+                    watching = shader_dir && shader_watcher_start(&watcher, &theme, shader_dir, &program_cache);
+                    if (watching && !event_loop_add_fd(&loop, watcher.ready_fd, EVENT_SHADERS))
+                    {
+                        shader_watcher_stop(&watcher);
+                        watching = false;
+                    }
+                }
+                bars_time = get_monotonic_time();
+            }
+            continue;
+        }
+
+        bool fresh = false;
+        uint64_t upload_start = metrics_now();
+        const float *cava_out = dsp_acquire_bars(&dsp, &fresh);
+        if (fresh || bars_stale)
+        {
+            bar_buffer_upload(&bar_buffer, cava_out);
+            bars_stale = false;
+            metrics_span(METRIC_UPLOAD, upload_start);
+        }
+        if (fresh)
+        {
+            bar_history_push(&bar_history, cava_out);
+            bars_time = now;
+        }
+
+        float current_time = (float)(now - start_time);
+        for (int i = 0; i < due_count; i++)
+        {
+            MonitorData *monitor = due[i];
+            if (!make_monitor_current(monitor))
+                continue;
+            uint64_t draw_start = metrics_now();
+            int width, height;
+            float scale = render_scaler_begin(&scaler, monitor, &width, &height);
+            FrameDamage damage = damage_tracker_begin(&damage_tracker, monitor, cava_out, scale);
+            // An offscreen target still holds this output's previous frame; the back buffer holds what its age says
+            int clip[4];
+            damage_box(scale < 1.0f ? damage.changed : damage.repaint, width, height, 1, clip);
+            renderer_draw(&renderer, width, height, current_time, clip);
+            render_scaler_end(&scaler, monitor, damage.repaint);
+            metrics_span(METRIC_DRAW, draw_start);
+
+            // The swap commits the surface, which also carries the frame request and the damage
+            request_frame(monitor);
+            uint64_t swap_start = metrics_now();
+            damage_tracker_swap(&damage_tracker, monitor, &damage);
+            metrics_span(METRIC_SWAP, swap_start);
+            atomic_fetch_add_explicit(&metrics.frames, 1, memory_order_relaxed);
+            monitor->last_frame_time = now;
+        }
+        bar_buffer_fence(&bar_buffer);
+    }
+    control_stop(&control);
+    reconfigurer_destroy(&reconfigurer);
+    if (watching)
+        shader_watcher_stop(&watcher);
+    event_loop_destroy(&loop);
+    bar_history_destroy(&bar_history);
+    bar_buffer_destroy(&bar_buffer);
+    damage_tracker_destroy(&damage_tracker);
+    render_scaler_destroy(&scaler);
+    renderer_destroy(&renderer);
     close_platform();
 
+    dsp_stop(&dsp);
+    dsp_destroy(&dsp);
+    if (config.publish)
+        bar_publisher_destroy(&publisher);
+
     pthread_mutex_lock(&audio_data.lock);
     audio_data.terminate = 1;
     pthread_mutex_unlock(&audio_data.lock);
     pthread_join(audio_thread, NULL);
+    cava_capture_close(capture);
 
     free(audio_data.source);
-    free(audio_data.cava_in);
+    free_cava_input_ring(&audio_data.ring);
 
     cava_destroy(plan);
     free(plan);
-    free(cava_out);
+    metrics_destroy();
 
     return 0;
 }
@@ -0,0 +1,227 @@
+#include "metrics.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+Metrics metrics;
+
+static const char *metric_names[METRIC_COUNT] = {"dsp", "upload", "draw", "swap", "frame latency", "samples"};
+
+void metrics_init(void)
+{
+    memset(&metrics, 0, sizeof(metrics));
+    metrics.start_ns = metrics_now();
+}
+
+void metrics_destroy(void)
+{
+    atomic_store(&metrics.trace.active, false);
+    free(metrics.trace.events);
+    metrics.trace.events = NULL;
+}
+
+uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int bucket_index(uint64_t value)
+{
+    if (value < METRIC_BUCKETS_PER_OCTAVE)
+        return (int)value;
+    int octave = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (octave - 2)) & (METRIC_BUCKETS_PER_OCTAVE - 1);
+    return octave * METRIC_BUCKETS_PER_OCTAVE + sub;
+}
+
+// Largest value that still falls into bucket `index`
+static uint64_t bucket_upper_bound(int index)
+{
+    if (index < 2 * METRIC_BUCKETS_PER_OCTAVE)
+        return (uint64_t)index;
+    int octave = index / METRIC_BUCKETS_PER_OCTAVE;
+    uint64_t sub = (uint64_t)(index % METRIC_BUCKETS_PER_OCTAVE);
+    return ((METRIC_BUCKETS_PER_OCTAVE + sub + 1) << (octave - 2)) - 1;
+}
+
+void metrics_record(Metric metric, uint64_t value)
+{
+    Histogram *histogram = &metrics.histograms[metric];
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    // Single writer per histogram, so a plain compare is enough
+    if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+        atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+}
+
+static uint32_t current_tid(void)
+{
+    static _Thread_local uint32_t tid;
+    if (tid == 0)
+        tid = (uint32_t)syscall(SYS_gettid);
+    return tid;
+}
+
+static void trace_event(Metric metric, uint64_t start_ns, uint64_t duration_ns)
+{
+    // Reserve before checking `active`, so trace_finish either sees this slot or we see the trace stopped. The
+    // counters are never reset: a writer left over from an earlier trace reserved before `base`, and its slot
+    // wraps around to far past the capacity.
+    uint32_t reserved = atomic_fetch_add(&metrics.trace.reserved, 1);
+    uint32_t slot = atomic_load(&metrics.trace.active) ? reserved - metrics.trace.base : TRACE_CAPACITY;
+    if (slot < TRACE_CAPACITY)
+    {
+        metrics.trace.events[slot] = (TraceEvent){
+            .start_ns = start_ns,
+            .duration_ns = duration_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)duration_ns,
+            .metric = (uint16_t)metric,
+            .tid = current_tid(),
+        };
+    }
+    atomic_fetch_add(&metrics.trace.committed, 1);
+}
+
+void metrics_span(Metric metric, uint64_t start_ns)
+{
+    uint64_t end_ns = metrics_now();
+    uint64_t duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    metrics_record(metric, duration_ns);
+    if (atomic_load_explicit(&metrics.trace.active, memory_order_relaxed))
+        trace_event(metric, start_ns, duration_ns);
+}
+
+static uint64_t histogram_percentile(const Histogram *histogram, uint64_t count, double p)
+{
+    uint64_t rank = (uint64_t)(p * (double)count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < METRIC_BUCKETS; i++)
+    {
+        seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (seen >= rank)
+        {
+            uint64_t bound = bucket_upper_bound(i);
+            uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+            return bound < max ? bound : max;
+        }
+    }
+    return atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+void metrics_dump(FILE *out)
+{
+    double uptime = (double)(metrics_now() - metrics.start_ns) / 1e9;
+    fprintf(out, "ywp metrics after %.1f s\n", uptime);
+    fprintf(out, "%-14s %10s %10s %10s %10s %10s\n", "metric", "count", "p50", "p99", "max", "mean");
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        const Histogram *histogram = &metrics.histograms[m];
+        uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+        if (count == 0)
+        {
+            fprintf(out, "%-14s %10d\n", metric_names[m], 0);
+            continue;
+        }
+
+        // Timings are shown in ms, the sample count as is
+        double scale = m == METRIC_SAMPLES ? 1.0 : 1e-6;
+        double mean = (double)atomic_load_explicit(&histogram->sum, memory_order_relaxed) / (double)count;
+        fprintf(out, "%-14s %10llu %10.4f %10.4f %10.4f %10.4f\n", metric_names[m], (unsigned long long)count,
+                (double)histogram_percentile(histogram, count, 0.50) * scale,
+                (double)histogram_percentile(histogram, count, 0.99) * scale,
+                (double)atomic_load_explicit(&histogram->max, memory_order_relaxed) * scale, mean * scale);
+    }
+
+    uint64_t frames = atomic_load_explicit(&metrics.frames, memory_order_relaxed);
+    double idle = (double)atomic_load_explicit(&metrics.idle_ns, memory_order_relaxed) / 1e9;
+    fprintf(out, "frames presented  %llu (%.1f per second)\n", (unsigned long long)frames,
+            uptime > 0.0 ? (double)frames / uptime : 0.0);
+    fprintf(out, "dsp idle          %.1f%%\n", uptime > 0.0 ? 100.0 * idle / uptime : 0.0);
+    fprintf(out, "input overruns    %llu\n",
+            (unsigned long long)atomic_load_explicit(&metrics.overruns, memory_order_relaxed));
+    fprintf(out, "cava frame rate   %.1f Hz\n",
+            (double)atomic_load_explicit(&metrics.cava_framerate, memory_order_relaxed) / 1e3);
+    fprintf(out, "fence timeouts    %llu\n",
+            (unsigned long long)atomic_load_explicit(&metrics.fence_timeouts, memory_order_relaxed));
+    fflush(out);
+}
+
+bool trace_start(double seconds)
+{
+    if (atomic_load(&metrics.trace.active) || metrics.trace.events != NULL)
+        return false;
+    // Zeroed, since a writer that reserved a slot just as the trace stopped leaves it empty
+    metrics.trace.events = calloc(TRACE_CAPACITY, sizeof(TraceEvent));
+    if (metrics.trace.events == NULL)
+        return false;
+
+    // Published to writers by the store to `active`
+    metrics.trace.base = atomic_load(&metrics.trace.reserved);
+    metrics.trace.end_ns = metrics_now() + (uint64_t)(seconds * 1e9);
+    atomic_store(&metrics.trace.active, true);
+    return true;
+}
+
+uint64_t trace_remaining(void)
+{
+    if (metrics.trace.events == NULL)
+        return 0;
+    uint64_t now = metrics_now();
+    return metrics.trace.end_ns > now ? metrics.trace.end_ns - now : 1;
+}
+
+bool trace_finish(const char *path, bool force)
+{
+    if (metrics.trace.events == NULL || (!force && metrics_now() < metrics.trace.end_ns))
+        return false;
+
+    // Writers that reserved a slot before `active` dropped may still be filling it in
+    atomic_store(&metrics.trace.active, false);
+    while (atomic_load(&metrics.trace.committed) != atomic_load(&metrics.trace.reserved))
+        sched_yield();
+
+    uint32_t count = atomic_load(&metrics.trace.reserved) - metrics.trace.base;
+    if (count > TRACE_CAPACITY)
+        count = TRACE_CAPACITY;
+
+    bool written = false;
+    FILE *file = fopen(path, "w");
+    if (file != NULL)
+    {
+        // Slots reserved after the trace stopped were never written and still have a zero start
+        uint64_t origin = UINT64_MAX;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t start_ns = metrics.trace.events[i].start_ns;
+            if (start_ns != 0 && start_ns < origin)
+                origin = start_ns;
+        }
+
+        // Complete ("X") events, timestamps in microseconds from the first one
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        const char *separator = "";
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const TraceEvent *event = &metrics.trace.events[i];
+            if (event->start_ns == 0)
+                continue;
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    separator, metric_names[event->metric], (int)getpid(), event->tid,
+                    (double)(event->start_ns - origin) / 1e3, (double)event->duration_ns / 1e3);
+            separator = ",\n";
+        }
+        fprintf(file, "\n]}\n");
+        written = fclose(file) == 0;
+    }
+
+    free(metrics.trace.events);
+    metrics.trace.events = NULL;
+    return written;
+}
@@ -0,0 +1,92 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Histogram buckets: four per power of two, so any percentile is within 19% of the real value
+#define METRIC_BUCKETS_PER_OCTAVE 4
+#define METRIC_BUCKETS (64 * METRIC_BUCKETS_PER_OCTAVE)
+// Events a trace can hold; recording stops early once they are used up
+#define TRACE_CAPACITY 65536
+
+typedef enum
+{
+    METRIC_DSP,           // Ring read and cava_execute of one analysis step (ns)
+    METRIC_UPLOAD,        // Streaming one frame of bars into the SSBO ring (ns)
+    METRIC_DRAW,          // Submitting one monitor's draw (ns)
+    METRIC_SWAP,          // eglSwapBuffers of one monitor (ns)
+    METRIC_FRAME_LATENCY, // Frame request committed to frame event received (ns)
+    METRIC_SAMPLES,       // New samples consumed by one analysis step
+    METRIC_COUNT,
+} Metric;
+
+// Log-linear histogram written by a single thread and read by any. Relaxed atomics are enough: a reader only
+// needs each field to be untorn, not a consistent snapshot across fields.
+typedef struct
+{
+    atomic_uint_least64_t buckets[METRIC_BUCKETS];
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t sum;
+    atomic_uint_least64_t max;
+} Histogram;
+
+typedef struct
+{
+    uint64_t start_ns;
+    uint32_t duration_ns;
+    uint16_t metric;
+    uint32_t tid;
+} TraceEvent;
+
+// Always-on counters for the render and DSP hot paths. Recording is a handful of relaxed atomic adds; reading
+// happens on the control thread (see control.h) when someone asks for a dump.
+typedef struct
+{
+    uint64_t start_ns;
+    Histogram histograms[METRIC_COUNT];
+    atomic_uint_least64_t frames;         // Frames presented, summed over monitors
+    atomic_uint_least64_t idle_ns;        // Time the DSP worker spent parked on silence
+    atomic_uint_least64_t overruns;       // Latest count of input ring writes that did not fit
+    atomic_uint_least64_t cava_framerate; // cava's own estimate of its execution rate, in mHz
+    atomic_uint_least64_t fence_timeouts; // Bar uploads that gave up waiting for the GPU to release a slot
+
+    // Chrome trace (chrome://tracing, Perfetto) of the spans above for a bounded window
+    struct
+    {
+        atomic_bool active;
+        atomic_uint_least32_t reserved;  // Slots handed out to writers, free running across traces
+        atomic_uint_least32_t committed; // Slots fully written, free running across traces
+        uint32_t base;                   // `reserved` when the current trace started, its first slot
+        uint64_t end_ns;
+        TraceEvent *events;
+    } trace;
+} Metrics;
+
+extern Metrics metrics;
+
+void metrics_init(void);
+void metrics_destroy(void);
+
+// CLOCK_MONOTONIC in nanoseconds, the time base of every metric and trace event
+uint64_t metrics_now(void);
+
+// Adds one value (nanoseconds for the timing metrics) to a histogram
+void metrics_record(Metric metric, uint64_t value);
+// Records the span from `start_ns` to now into `metric` and, while a trace runs, into the trace
+void metrics_span(Metric metric, uint64_t start_ns);
+
+// Writes every histogram and counter as a plain text table
+void metrics_dump(FILE *out);
+
+// Starts recording trace events for `seconds`. Returns false if a trace is already running.
+bool trace_start(double seconds);
+// Once the window is over (or `force`), stops recording and writes the events as Chrome trace JSON to `path`.
+// Returns false while the window is still open or the file cannot be written.
+bool trace_finish(const char *path, bool force);
+// Nanoseconds left in the current trace window, 0 if none is running
+uint64_t trace_remaining(void);
+
+#endif // METRICS_H
@@ -0,0 +1,66 @@
+#include "paths.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Like `mkdir -p`, but only for the last two components: the XDG base directory itself may not exist yet
+static bool make_dirs(char *path)
+{
+    char *slash = strrchr(path, '/');
+    if (slash && slash != path)
+    {
+        *slash = '\0';
+        bool parent_ok = mkdir(path, 0700) == 0 || errno == EEXIST;
+        *slash = '/';
+        if (!parent_ok)
+            return false;
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+// Resolves `$xdg_variable/ywp`, or `$HOME/home_fallback/ywp` when the variable is unset or not absolute as the
+// spec requires, and creates it when `create` is set
+static bool get_xdg_dir(const char *xdg_variable, const char *home_fallback, bool create, char *path, size_t size)
+{
+    const char *base = getenv(xdg_variable);
+    int written;
+    if (base && base[0] == '/')
+    {
+        written = snprintf(path, size, "%s/ywp", base);
+    }
+    else
+    {
+        const char *home = getenv("HOME");
+        if (home == NULL || home[0] == '\0')
+            return false;
+        written = snprintf(path, size, "%s/%s/ywp", home, home_fallback);
+    }
+    if (written < 0 || (size_t)written >= size)
+        return false;
+    return !create || make_dirs(path);
+}
+
+bool get_cache_dir(char *path, size_t size)
+{
+    return get_xdg_dir("XDG_CACHE_HOME", ".cache", true, path, size);
+}
+
+bool get_runtime_dir(char *path, size_t size)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir == NULL || dir[0] != '/')
+        return false;
+    int written = snprintf(path, size, "%s", dir);
+    return written >= 0 && (size_t)written < size;
+}
+
+bool get_shader_dir(char *path, size_t size)
+{
+    if (!get_xdg_dir("XDG_CONFIG_HOME", ".config", false, path, size))
+        return false;
+    size_t length = strlen(path);
+    int written = snprintf(path + length, size - length, "/shaders");
+    return written >= 0 && (size_t)written < size - length;
+}
@@ -0,0 +1,16 @@
+#ifndef PATHS_H
+#define PATHS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Writes ywp's cache directory ($XDG_CACHE_HOME/ywp, falling back to ~/.cache/ywp) into `path` and creates it
+// if needed. Returns false when there is no usable home or the directory cannot be created.
+bool get_cache_dir(char *path, size_t size);
+// Writes the directory user shaders are loaded from ($XDG_CONFIG_HOME/ywp/shaders, falling back to
+// ~/.config/ywp/shaders) into `path`. Nothing is created; the directory is optional.
+bool get_shader_dir(char *path, size_t size);
+// Writes $XDG_RUNTIME_DIR into `path`; false when it is unset, there is no fallback
+bool get_runtime_dir(char *path, size_t size);
+
+#endif // PATHS_H
@@ -1,8 +1,9 @@
 #include "platform.h"
+#include "metrics.h"
 #include "wlr-layer-shell-client-protocol.h"
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
-#include <GL/gl.h>
+#include <GLES3/gl31.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -16,51 +17,68 @@
 PlatformData platform = {0};
 CoreData core = {0};
 
-static void handle_surface_enter(void *data, struct wl_surface *surface, struct wl_output *output)
+// Frame events held back because the wallpaper was hidden say nothing about latency
+#define MAX_FRAME_LATENCY_NS 1000000000ull
+
+static void handle_frame_done(void *data, struct wl_callback *callback, uint32_t time)
 {
-    for (int i = 0; i < platform.monitorCount; i++)
-    {
-        if (platform.monitors[i].output == output)
-        {
-            platform.currentMonitorIndex = i;
-            return;
-        }
-    }
+    MonitorData *monitor = data;
+    wl_callback_destroy(callback);
+    monitor->frame.callback = NULL;
+    monitor->frame.last_time = time;
+
+    uint64_t latency = metrics_now() - monitor->frame.request_time;
+    if (latency < MAX_FRAME_LATENCY_NS)
+        metrics_record(METRIC_FRAME_LATENCY, latency);
 }
-static void handle_surface_leave(void *data, struct wl_surface *surface, struct wl_output *output)
+
+static const struct wl_callback_listener frame_listener = {
+    .done = &handle_frame_done,
+};
+
+bool monitor_drawable(const MonitorData *monitor)
 {
-    for (int i = 0; i < platform.monitorCount; i++)
-    {
-        if (platform.monitors[i].output == output)
-        {
-            platform.currentMonitorIndex = -1;
-            return;
-        }
-    }
+    return monitor->output && monitor->configured && monitor->egl_surface != EGL_NO_SURFACE;
 }
-static const struct wl_surface_listener surface_listener = {
-    .enter = &handle_surface_enter,
-    .leave = &handle_surface_leave,
-};
+
+bool make_monitor_current(MonitorData *monitor)
+{
+    return eglMakeCurrent(platform.egl.device, monitor->egl_surface, monitor->egl_surface, platform.egl.context) !=
+           EGL_FALSE;
+}
+
+void request_frame(MonitorData *monitor)
+{
+    if (monitor->frame.callback)
+        return;
+    monitor->frame.callback = wl_surface_frame(monitor->surface);
+    wl_callback_add_listener(monitor->frame.callback, &frame_listener, monitor);
+    monitor->frame.request_time = metrics_now();
+}
+
+bool frame_pending(const MonitorData *monitor)
+{
+    return monitor->frame.callback != NULL;
+}
+
+static void destroy_monitor_surface(MonitorData *monitor);
 
 static void layer_surface_configure(void *data, struct zwlr_layer_surface_v1 *zwlr_layer_surface_v1, uint32_t serial,
                                     uint32_t width, uint32_t height)
 {
-    core.window_size.width = width;
-    core.window_size.height = height;
+    MonitorData *monitor = data;
+    monitor->surface_width = width;
+    monitor->surface_height = height;
+    monitor->configured = true;
 
-    zwlr_layer_surface_v1_ack_configure(platform.layer_surface, serial);
-    wl_egl_window_resize(platform.egl_window, width, height, 0, 0);
-    eglMakeCurrent(platform.egl.device, platform.egl.surface, platform.egl.surface, platform.egl.context);
-    glViewport(0, 0, width, height);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, width, 0, height, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    zwlr_layer_surface_v1_ack_configure(monitor->layer_surface, serial);
+    wl_egl_window_resize(monitor->egl_window, width, height, 0, 0);
 }
 static void layer_surface_closed(void *data, struct zwlr_layer_surface_v1 *zwlr_layer_surface_v1)
 {
+    // The compositor took the surface away, usually because its output is going; the output global itself
+    // is released in registry_handle_global_remove
+    destroy_monitor_surface(data);
 }
 
 static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
@@ -68,6 +86,79 @@ static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
     .closed = &layer_surface_closed,
 };
 
+// Creates the wallpaper surface for `monitor`. Needs the layer shell and the shared EGL context, so outputs
+// announced before init_platform finished get theirs there and hotplugged ones right away.
+static bool create_monitor_surface(MonitorData *monitor)
+{
+    if (monitor->surface || !platform.compositor || !platform.layer_shell ||
+        platform.egl.context == EGL_NO_CONTEXT)
+        return false;
+
+    monitor->surface = wl_compositor_create_surface(platform.compositor);
+    if (monitor->surface == NULL)
+        return false;
+
+    monitor->layer_surface =
+        zwlr_layer_shell_v1_get_layer_surface(platform.layer_shell, monitor->surface, monitor->output,
+                                              ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, "wayland_app");
+    zwlr_layer_surface_v1_set_size(monitor->layer_surface, 0, 0);
+    zwlr_layer_surface_v1_set_anchor(monitor->layer_surface,
+                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                                         ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+    zwlr_layer_surface_v1_add_listener(monitor->layer_surface, &layer_surface_listener, monitor);
+    zwlr_layer_surface_v1_set_keyboard_interactivity(
+        monitor->layer_surface,
+        ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_NONE); // No keyboard interactivity--for now ;)
+    zwlr_layer_surface_v1_set_exclusive_zone(monitor->layer_surface, -1);
+
+    monitor->egl_window =
+        wl_egl_window_create(monitor->surface, 800, 600); // Initial size; will be resized on configure
+    monitor->egl_surface = eglCreateWindowSurface(platform.egl.device, platform.egl.config,
+                                                  (EGLNativeWindowType)monitor->egl_window, NULL);
+    if (monitor->egl_surface == EGL_NO_SURFACE)
+    {
+        destroy_monitor_surface(monitor);
+        return false;
+    }
+
+    // Frame pacing is driven by wl_surface.frame callbacks, so the swap itself must never block. The swap
+    // interval belongs to the surface that is current when it is set.
+    if (make_monitor_current(monitor))
+        eglSwapInterval(platform.egl.device, 0);
+
+    monitor->configured = false;
+    monitor->last_frame_time = -1.0;
+    wl_surface_commit(monitor->surface);
+    return true;
+}
+
+static void destroy_monitor_surface(MonitorData *monitor)
+{
+    if (monitor->frame.callback)
+        wl_callback_destroy(monitor->frame.callback);
+    monitor->frame.callback = NULL;
+
+    if (monitor->egl_surface != EGL_NO_SURFACE)
+    {
+        // The context stays alive without a surface, so the shared program and buffers survive hotplug
+        if (eglGetCurrentSurface(EGL_DRAW) == monitor->egl_surface)
+            eglMakeCurrent(platform.egl.device, EGL_NO_SURFACE, EGL_NO_SURFACE, platform.egl.context);
+        eglDestroySurface(platform.egl.device, monitor->egl_surface);
+    }
+    monitor->egl_surface = EGL_NO_SURFACE;
+
+    if (monitor->egl_window)
+        wl_egl_window_destroy(monitor->egl_window);
+    monitor->egl_window = NULL;
+    if (monitor->layer_surface)
+        zwlr_layer_surface_v1_destroy(monitor->layer_surface);
+    monitor->layer_surface = NULL;
+    if (monitor->surface)
+        wl_surface_destroy(monitor->surface);
+    monitor->surface = NULL;
+    monitor->configured = false;
+}
+
 static void handle_pointer_enter(void *data, struct wl_pointer *poiner, uint32_t serial, struct wl_surface *surface,
                                  wl_fixed_t sx, wl_fixed_t sy)
 {
@@ -277,20 +368,37 @@ static void registry_handle_global(void *data, struct wl_registry *registry, uin
     }
     else if (strcmp(interface, wl_output_interface.name) == 0)
     {
-        if (platform.monitorCount < MAX_MONITORS)
+        for (int i = 0; i < MAX_MONITORS; i++)
         {
-            MonitorData *monitor = &platform.monitors[platform.monitorCount];
+            MonitorData *monitor = &platform.monitors[i];
+            if (monitor->output)
+                continue;
+
+            *monitor = (MonitorData){.name = name, .egl_surface = EGL_NO_SURFACE};
             monitor->output = wl_registry_bind(registry, name, &wl_output_interface, 4);
             wl_output_add_listener(monitor->output, &output_listener, monitor);
             platform.monitorCount++;
-        }
-        else
-        {
+
+            // Hotplugged output: the context already exists, so it can get its surface immediately
+            create_monitor_surface(monitor);
+            break;
         }
     }
 }
 static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
 {
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        MonitorData *monitor = &platform.monitors[i];
+        if (!monitor->output || monitor->name != name)
+            continue;
+
+        destroy_monitor_surface(monitor);
+        wl_output_release(monitor->output);
+        monitor->output = NULL;
+        platform.monitorCount--;
+        return;
+    }
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -301,13 +409,18 @@ static const struct wl_registry_listener registry_listener = {
 bool init_platform(void)
 {
     const EGLint framebufferAttribs[] = {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
-        EGL_NONE};
-    const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8, EGL_NONE};
+    // GLES 3.1 is the lowest version with SSBOs, which is what the shaders are written against
+    const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE};
 
     EGLint numConfigs = 0;
 
     platform.display = wl_display_connect(NULL);
+    if (platform.display == NULL)
+    {
+        return false;
+    }
 
     platform.registry = wl_display_get_registry(platform.display);
     wl_registry_add_listener(platform.registry, &registry_listener, NULL);
@@ -319,7 +432,7 @@ bool init_platform(void)
     {
         return false;
     }
-    if (eglBindAPI(EGL_OPENGL_API) == EGL_FALSE)
+    if (eglBindAPI(EGL_OPENGL_ES_API) == EGL_FALSE)
     {
         return false;
     }
@@ -331,14 +444,14 @@ bool init_platform(void)
     platform.egl.context = eglCreateContext(platform.egl.device, platform.egl.config, EGL_NO_CONTEXT, contextAttribs);
     if (platform.egl.context == EGL_NO_CONTEXT)
     {
-        return -1;
+        return false;
     }
 
-    platform.surface = wl_compositor_create_surface(platform.compositor);
-    wl_surface_add_listener(platform.surface, &surface_listener, NULL);
-    if (platform.surface == NULL)
+    // The context lives on without a surface between monitors (and with none connected), so the program and
+    // buffers created against it are shared by every output
+    if (eglMakeCurrent(platform.egl.device, EGL_NO_SURFACE, EGL_NO_SURFACE, platform.egl.context) == EGL_FALSE)
     {
-        return -1;
+        return false;
     }
 
     platform.cursor.theme = wl_cursor_theme_load(NULL, CURSOR_SIZE, platform.cursor.shm);
@@ -349,40 +462,83 @@ bool init_platform(void)
     {
         platform.cursor.surface = wl_compositor_create_surface(platform.compositor);
     }
-    platform.layer_surface = zwlr_layer_shell_v1_get_layer_surface(platform.layer_shell, platform.surface, NULL,
-                                                                   ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, "wayland_app");
 
-    // zwlr_layer_surface_v1_set_size(platform.layer_surface, screen_width, screen_height);
-    zwlr_layer_surface_v1_set_size(platform.layer_surface, 0, 0);
-    zwlr_layer_surface_v1_set_anchor(platform.layer_surface,
-                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
-                                         ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
-    zwlr_layer_surface_v1_add_listener(platform.layer_surface, &layer_surface_listener, &platform);
-    zwlr_layer_surface_v1_set_keyboard_interactivity(
-        platform.layer_surface,
-        ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_NONE); // No keyboard interactivity--for now ;)
-    zwlr_layer_surface_v1_set_exclusive_zone(platform.layer_surface, -1);
-
-    platform.egl_window =
-        wl_egl_window_create(platform.surface, 800, 600); // Initial size; will be resized on configure
-    platform.egl.surface = eglCreateWindowSurface(platform.egl.device, platform.egl.config,
-                                                  (EGLNativeWindowType)platform.egl_window, NULL);
-    wl_surface_commit(platform.surface);
+    if (!platform.layer_shell)
+    {
+        return false;
+    }
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        if (platform.monitors[i].output)
+            create_monitor_surface(&platform.monitors[i]);
+    }
+    // Second roundtrip picks up the output modes and the first configure of every surface
     wl_display_roundtrip(platform.display);
 
-    eglSwapInterval(platform.egl.device, 1);
+    return true;
+}
+
+EGLContext create_shared_context(void)
+{
+    const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE};
+    if (platform.egl.context == EGL_NO_CONTEXT)
+        return EGL_NO_CONTEXT;
+    return eglCreateContext(platform.egl.device, platform.egl.config, platform.egl.context, contextAttribs);
+}
+
+bool init_headless_platform(int width, int height)
+{
+    const EGLint framebufferAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8, EGL_NONE};
+    const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE};
+    const EGLint pbufferAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+
+    EGLint numConfigs = 0;
 
-    EGLBoolean result =
-        eglMakeCurrent(platform.egl.device, platform.egl.surface, platform.egl.surface, platform.egl.context);
-    if (result != EGL_FALSE)
+    // Prefer Mesa's surfaceless platform so no display server is needed at all, and fall back to whatever the
+    // default display is otherwise
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    platform.egl.device = EGL_NO_DISPLAY;
+    if (getPlatformDisplay)
+        platform.egl.device = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (platform.egl.device == EGL_NO_DISPLAY)
+        platform.egl.device = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (eglInitialize(platform.egl.device, NULL, NULL) == EGL_FALSE)
     {
+        return false;
     }
-    else
+    if (eglBindAPI(EGL_OPENGL_ES_API) == EGL_FALSE)
+    {
+        return false;
+    }
+    if (eglChooseConfig(platform.egl.device, framebufferAttribs, &platform.egl.config, 1, &numConfigs) == EGL_FALSE ||
+        numConfigs == 0)
+    {
+        return false;
+    }
+    platform.egl.context = eglCreateContext(platform.egl.device, platform.egl.config, EGL_NO_CONTEXT, contextAttribs);
+    if (platform.egl.context == EGL_NO_CONTEXT)
     {
-        return -1;
+        return false;
+    }
+    platform.egl.surface = eglCreatePbufferSurface(platform.egl.device, platform.egl.config, pbufferAttribs);
+    if (platform.egl.surface == EGL_NO_SURFACE)
+    {
+        return false;
+    }
+    if (eglMakeCurrent(platform.egl.device, platform.egl.surface, platform.egl.surface, platform.egl.context) ==
+        EGL_FALSE)
+    {
+        return false;
     }
+    eglSwapInterval(platform.egl.device, 0);
 
-    return 0;
+    core.window_size.width = width;
+    core.window_size.height = height;
+    return true;
 }
 
 // Close platform
@@ -402,8 +558,16 @@ bool close_platform(void)
     if (platform.seat)
         wl_seat_release(platform.seat);
 
-    if (platform.layer_surface)
-        zwlr_layer_surface_v1_destroy(platform.layer_surface);
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        MonitorData *monitor = &platform.monitors[i];
+        if (!monitor->output)
+            continue;
+        destroy_monitor_surface(monitor);
+        wl_output_release(monitor->output);
+        monitor->output = NULL;
+    }
+    platform.monitorCount = 0;
 
     if (platform.egl.device)
     {
@@ -418,12 +582,6 @@ bool close_platform(void)
         eglTerminate(platform.egl.device);
     }
 
-    if (platform.egl_window)
-        wl_egl_window_destroy(platform.egl_window);
-
-    if (platform.surface)
-        wl_surface_destroy(platform.surface);
-
     if (platform.layer_shell)
         zwlr_layer_shell_v1_destroy(platform.layer_shell);
     if (platform.compositor)
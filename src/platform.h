@@ -3,6 +3,7 @@
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <wayland-client.h>
 #include <wayland-cursor.h>
@@ -15,19 +16,35 @@
 
 typedef struct
 {
-    struct wl_output *output;
+    struct wl_output *output; // NULL while the slot is free
+    uint32_t name;            // Registry name of the wl_output global, matched against global_remove
     int width;
     int height;
     int refresh;
     int scale;
+
+    // Wallpaper surface covering this output, all of them share the one EGL context
+    struct wl_surface *surface;
+    struct zwlr_layer_surface_v1 *layer_surface;
+    struct wl_egl_window *egl_window;
+    EGLSurface egl_surface;
+    bool configured; // Set by the first configure event, the surface has no size before it
+    int surface_width;
+    int surface_height;
+
+    struct
+    {
+        struct wl_callback *callback; // Pending wl_surface.frame request, NULL once it fired
+        uint32_t last_time;           // Timestamp (ms) of the last frame event
+        uint64_t request_time;        // metrics_now() when the pending request was made
+    } frame;
+    double last_frame_time; // Monotonic time the render loop last drew this output, for the fps cap
 } MonitorData;
 
 typedef struct
 {
     struct wl_display *display;
     struct wl_compositor *compositor;
-    struct wl_surface *surface;
-    struct wl_egl_window *egl_window;
     struct wl_registry *registry;
     struct wl_seat *seat;
     struct wl_pointer *pointer;
@@ -43,11 +60,9 @@ typedef struct
     } cursor;
 
     int monitorCount;
-    int currentMonitorIndex;
-    MonitorData monitors[MAX_MONITORS];
+    MonitorData monitors[MAX_MONITORS]; // Slots are reused as outputs come and go, check `output` first
 
     struct zwlr_layer_shell_v1 *layer_shell;
-    struct zwlr_layer_surface_v1 *layer_surface;
 
     struct
     {
@@ -59,7 +74,7 @@ typedef struct
     struct
     {
         EGLDisplay device;  // Native display device (physical screen connection)
-        EGLSurface surface; // Surface to draw on, framebuffers (connected to context)
+        EGLSurface surface; // Offscreen pbuffer of the headless platform; monitors carry their own surfaces
         EGLContext context; // Graphic context, mode in which drawing can be done
         EGLConfig config;   // Graphic config
     } egl;
@@ -79,6 +94,19 @@ extern PlatformData platform;
 extern CoreData core;
 
 bool init_platform();
+// Offscreen pbuffer context of the given size without any Wayland connection, for benchmarks
+bool init_headless_platform(int width, int height);
 bool close_platform();
+// Second context sharing programs and buffers with the main one, for another thread to make current surfaceless
+EGLContext create_shared_context(void);
+
+// True once the monitor has a configured wallpaper surface that can be drawn to
+bool monitor_drawable(const MonitorData *monitor);
+// Binds the monitor's surface to the shared context; the program and buffers stay bound across monitors
+bool make_monitor_current(MonitorData *monitor);
+// Asks the compositor for a frame event on the next commit (eglSwapBuffers commits for us)
+void request_frame(MonitorData *monitor);
+// True while a requested frame event has not arrived yet; the compositor withholds it while we are hidden
+bool frame_pending(const MonitorData *monitor);
 
 #endif // PLATFORM_H
@@ -0,0 +1,166 @@
+#include "program_cache.h"
+#include "shader.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PROGRAM_CACHE_MAGIC 0x42505779u // "yWPB"
+#define PROGRAM_CACHE_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t driver_hash;
+    uint32_t format; // GLenum reported by glGetProgramBinary
+    uint32_t length; // Bytes of binary following the header
+} ProgramCacheHeader;
+
+// 64-bit FNV-1a, chained through `hash` so several buffers can be folded into one key
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const GLubyte *string)
+{
+    const char *text = string ? (const char *)string : "";
+    // The terminator goes in too, so ("ab", "c") and ("a", "bc") hash differently
+    return hash_bytes(hash, text, strlen(text) + 1);
+}
+
+void program_cache_init(ProgramCache *cache, const char *cache_dir)
+{
+    memset(cache, 0, sizeof(*cache));
+    if (cache_dir == NULL)
+        return;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0)
+        return;
+
+    int written = snprintf(cache->dir, sizeof(cache->dir), "%s/programs", cache_dir);
+    if (written < 0 || (size_t)written >= sizeof(cache->dir) || (mkdir(cache->dir, 0700) != 0 && errno != EEXIST))
+        return;
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hash_string(hash, glGetString(GL_VENDOR));
+    hash = hash_string(hash, glGetString(GL_RENDERER));
+    hash = hash_string(hash, glGetString(GL_VERSION));
+    cache->driver_hash = hash;
+    cache->enabled = true;
+}
+
+static GLuint load_program(const ProgramCache *cache, const char *path, uint64_t source_hash)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+
+    ProgramCacheHeader header;
+    void *binary = NULL;
+    GLuint program = 0;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_CACHE_MAGIC &&
+        header.version == PROGRAM_CACHE_VERSION && header.source_hash == source_hash &&
+        header.driver_hash == cache->driver_hash && header.length > 0 && (binary = malloc(header.length)) != NULL &&
+        fread(binary, 1, header.length, file) == header.length)
+    {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, (GLsizei)header.length);
+
+        // Drivers may still reject a binary they produced, e.g. after a change the version string misses
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    free(binary);
+    fclose(file);
+    return program;
+}
+
+// Written to a temporary file and renamed over the old one, so a crash or a second instance never leaves a
+// torn binary behind
+static void store_program(const ProgramCache *cache, const char *path, uint64_t source_hash, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    void *binary = length > 0 ? malloc((size_t)length) : NULL;
+    if (binary == NULL)
+        return;
+
+    ProgramCacheHeader header = {
+        .magic = PROGRAM_CACHE_MAGIC,
+        .version = PROGRAM_CACHE_VERSION,
+        .source_hash = source_hash,
+        .driver_hash = cache->driver_hash,
+    };
+    GLenum format = 0;
+    GLsizei written_length = 0;
+    glGetProgramBinary(program, length, &written_length, &format, binary);
+    header.format = format;
+    header.length = (uint32_t)written_length;
+
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE *file = written_length > 0 ? fopen(tmp_path, "wb") : NULL;
+    if (file != NULL)
+    {
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(binary, 1, header.length, file) == header.length;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmp_path, path) != 0)
+            unlink(tmp_path);
+    }
+    free(binary);
+}
+
+GLuint program_cache_load_theme(ProgramCache *cache, const Theme *theme, const char *shader_dir)
+{
+    ThemeSources sources;
+    if (!load_theme_sources(theme, shader_dir, &sources))
+        return 0;
+
+    uint64_t source_hash = 0xcbf29ce484222325ull;
+    source_hash = hash_bytes(source_hash, sources.vertex, (size_t)sources.vertex_len + 1);
+    source_hash = hash_bytes(source_hash, sources.fragment, (size_t)sources.fragment_len + 1);
+
+    char path[PATH_MAX];
+    bool cached = cache->enabled && snprintf(path, sizeof(path), "%s/%s.bin", cache->dir, theme->name) <
+                                        (int)sizeof(path);
+
+    GLuint program = cached ? load_program(cache, path, source_hash) : 0;
+    if (program == 0)
+    {
+        program = glCreateProgram();
+        if (cached)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        if (link_shader_program(program, sources.vertex, sources.vertex_len, sources.fragment, sources.fragment_len))
+        {
+            if (cached)
+                store_program(cache, path, source_hash, program);
+        }
+        else
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    free_theme_sources(&sources);
+    return program;
+}
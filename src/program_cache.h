@@ -0,0 +1,28 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GLES3/gl31.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "theme.h"
+
+// Linked programs are kept on disk as driver binaries (glGetProgramBinary), one file per theme. Each file records
+// a hash of the sources it was linked from and of the GL vendor, renderer and version strings, so an edited
+// shader or a driver update simply relinks and overwrites it.
+typedef struct
+{
+    bool enabled; // False without a cache directory or when the driver offers no binary formats
+    char dir[PATH_MAX];
+    uint64_t driver_hash;
+} ProgramCache;
+
+// Needs a current context to query the driver. `cache_dir` may be NULL to always link from source.
+void program_cache_init(ProgramCache *cache, const char *cache_dir);
+
+// Loads the theme's sources (see load_theme_sources) and returns its program, from the cache when the binary
+// still matches and linked from source otherwise. Returns 0 if the sources cannot be read or fail to build.
+GLuint program_cache_load_theme(ProgramCache *cache, const Theme *theme, const char *shader_dir);
+
+#endif // PROGRAM_CACHE_H
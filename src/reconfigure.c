@@ -0,0 +1,195 @@
+#include "reconfigure.h"
+#include "theme.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+bool reconfigurer_init(Reconfigurer *reconfigurer, const AnalysisSettings *settings, const char *theme,
+                       unsigned int rate, int channels, const char *shader_dir)
+{
+    memset(reconfigurer, 0, sizeof(*reconfigurer));
+    reconfigurer->rate = rate;
+    reconfigurer->channels = channels;
+    reconfigurer->shader_dir = shader_dir;
+    reconfigurer->settings = *settings;
+    snprintf(reconfigurer->theme, sizeof(reconfigurer->theme), "%s", theme);
+
+    reconfigurer->ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reconfigurer->ready_fd < 0)
+        return false;
+    pthread_mutex_init(&reconfigurer->lock, NULL);
+    return true;
+}
+
+static void destroy_plan(struct cava_plan *plan)
+{
+    if (plan == NULL)
+        return;
+    cava_destroy(plan);
+    free(plan);
+}
+
+void reconfigurer_destroy(Reconfigurer *reconfigurer)
+{
+    destroy_plan(reconfigurer->plan);
+    for (int i = 0; i < RETIRED_PLANS; i++)
+        destroy_plan(reconfigurer->retired[i]);
+    pthread_mutex_destroy(&reconfigurer->lock);
+    close(reconfigurer->ready_fd);
+}
+
+static bool parse_int(const char *value, int *out)
+{
+    char *end = NULL;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < 1 || parsed > INT_MAX)
+        return false;
+    *out = (int)parsed;
+    return true;
+}
+
+static bool parse_smoothing(const char *value, double *out)
+{
+    char *end = NULL;
+    double parsed = strtod(value, &end);
+    if (end == value || *end != '\0' || parsed < 0.0 || parsed > 1.0)
+        return false;
+    *out = parsed;
+    return true;
+}
+
+void reconfigurer_set(Reconfigurer *reconfigurer, char *arguments, FILE *out)
+{
+    struct cava_plan *retired[RETIRED_PLANS];
+    pthread_mutex_lock(&reconfigurer->lock);
+    AnalysisSettings settings = reconfigurer->settings;
+    memcpy(retired, reconfigurer->retired, sizeof(retired));
+    memset(reconfigurer->retired, 0, sizeof(reconfigurer->retired));
+    pthread_mutex_unlock(&reconfigurer->lock);
+    for (int i = 0; i < RETIRED_PLANS; i++)
+        destroy_plan(retired[i]);
+
+    // Parse every pair before acting on any, so a typo in the last one does not leave a half-applied change
+    bool analysis_changed = false;
+    const char *theme = NULL;
+    char *save = NULL;
+    for (char *key = strtok_r(arguments, " \t", &save); key != NULL; key = strtok_r(NULL, " \t", &save))
+    {
+        char *value = strtok_r(NULL, " \t", &save);
+        if (value == NULL)
+        {
+            fprintf(out, "set: %s needs a value\n", key);
+            return;
+        }
+
+        bool valid = true;
+        if (strcmp(key, "bars") == 0)
+            valid = parse_int(value, &settings.bars_per_channel);
+        else if (strcmp(key, "low") == 0)
+            valid = parse_int(value, &settings.low_cut_off);
+        else if (strcmp(key, "high") == 0)
+            valid = parse_int(value, &settings.high_cut_off);
+        else if (strcmp(key, "smoothing") == 0)
+            valid = parse_smoothing(value, &settings.noise_reduction);
+        else if (strcmp(key, "theme") == 0)
+        {
+            Theme found;
+            valid = strlen(value) < NAME_MAX && find_theme(value, reconfigurer->shader_dir, &found);
+            theme = value;
+        }
+        else
+        {
+            fprintf(out, "set: unknown setting '%s' (bars, low, high, smoothing or theme)\n", key);
+            return;
+        }
+        if (!valid)
+        {
+            fprintf(out, "set: invalid %s '%s'\n", key, value);
+            return;
+        }
+        analysis_changed |= strcmp(key, "theme") != 0;
+    }
+    if (!analysis_changed && theme == NULL)
+    {
+        fprintf(out, "usage: set [bars <count>] [low <hz>] [high <hz>] [smoothing <0-1>] [theme <name>]\n");
+        return;
+    }
+
+    // Plans usually come straight from the wisdom cache; a size the cache lacks is measured here, off the
+    // render thread, while the old plan keeps running
+    struct cava_plan *plan = NULL;
+    if (analysis_changed)
+    {
+        plan = cava_init(settings.bars_per_channel, reconfigurer->rate, reconfigurer->channels, 0,
+                         settings.noise_reduction, settings.low_cut_off, settings.high_cut_off);
+        if (plan->status != 0)
+        {
+            fprintf(out, "set: %s", plan->error_message);
+            free(plan);
+            return;
+        }
+    }
+
+    struct cava_plan *superseded = NULL;
+    pthread_mutex_lock(&reconfigurer->lock);
+    if (plan != NULL)
+    {
+        superseded = reconfigurer->plan;
+        reconfigurer->plan = plan;
+        reconfigurer->settings = settings;
+    }
+    if (theme != NULL)
+    {
+        snprintf(reconfigurer->theme, sizeof(reconfigurer->theme), "%s", theme);
+        reconfigurer->theme_pending = true;
+    }
+    pthread_mutex_unlock(&reconfigurer->lock);
+    destroy_plan(superseded);
+
+    uint64_t one = 1;
+    if (write(reconfigurer->ready_fd, &one, sizeof(one)) < 0)
+    {
+        // Counter saturated; the render loop is woken anyway
+    }
+    reconfigurer_dump(reconfigurer, out);
+}
+
+void reconfigurer_dump(Reconfigurer *reconfigurer, FILE *out)
+{
+    pthread_mutex_lock(&reconfigurer->lock);
+    const AnalysisSettings *settings = &reconfigurer->settings;
+    fprintf(out, "bars %d low %d high %d smoothing %.2f theme %s\n", settings->bars_per_channel,
+            settings->low_cut_off, settings->high_cut_off, settings->noise_reduction, reconfigurer->theme);
+    pthread_mutex_unlock(&reconfigurer->lock);
+}
+
+struct cava_plan *reconfigurer_take(Reconfigurer *reconfigurer, char *theme, size_t size)
+{
+    uint64_t count;
+    if (read(reconfigurer->ready_fd, &count, sizeof(count)) < 0)
+    {
+        // Nothing pending
+    }
+
+    pthread_mutex_lock(&reconfigurer->lock);
+    struct cava_plan *plan = reconfigurer->plan;
+    reconfigurer->plan = NULL;
+    snprintf(theme, size, "%s", reconfigurer->theme_pending ? reconfigurer->theme : "");
+    reconfigurer->theme_pending = false;
+    pthread_mutex_unlock(&reconfigurer->lock);
+    return plan;
+}
+
+void reconfigurer_retire(Reconfigurer *reconfigurer, struct cava_plan *plan)
+{
+    pthread_mutex_lock(&reconfigurer->lock);
+    int slot = 0;
+    while (slot < RETIRED_PLANS && reconfigurer->retired[slot] != NULL)
+        slot++;
+    assert(slot < RETIRED_PLANS);
+    reconfigurer->retired[slot] = plan;
+    pthread_mutex_unlock(&reconfigurer->lock);
+}
@@ -0,0 +1,53 @@
+#ifndef RECONFIGURE_H
+#define RECONFIGURE_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "cavacore.h"
+#include "config.h"
+
+// Every `set` frees the plans retired before it started, and the render loop can take at most two plans in the
+// meantime: the one waiting when it started and its own
+#define RETIRED_PLANS 2
+
+// Settings changed through the control socket (`set <key> <value>...`, see control.h) while ywp runs. The
+// control thread builds the new cava_plan itself, so FFTW planning never stalls a frame; the render loop picks
+// the plan or theme up when `ready_fd` fires and swaps it in between two frames.
+typedef struct
+{
+    pthread_mutex_t lock;
+    unsigned int rate;
+    int channels;
+    const char *shader_dir; // Where custom themes are looked up, may be NULL
+    int ready_fd;           // eventfd signalled when a plan or a theme is waiting
+
+    // Everything below is guarded by `lock`
+    AnalysisSettings settings;   // What the newest plan was built from, taken or not
+    char theme[NAME_MAX];        // Newest theme, taken or not
+    struct cava_plan *plan;      // Built plan the render loop has not taken yet, NULL if none
+    bool theme_pending;          // `theme` has not been taken yet
+    struct cava_plan *retired[RETIRED_PLANS]; // Plans the render loop swapped out, for the control thread to free
+} Reconfigurer;
+
+bool reconfigurer_init(Reconfigurer *reconfigurer, const AnalysisSettings *settings, const char *theme,
+                       unsigned int rate, int channels, const char *shader_dir);
+// Call once the control thread is stopped
+void reconfigurer_destroy(Reconfigurer *reconfigurer);
+
+// Applies `key value` pairs from a control client (bars, low, high, smoothing, theme) and writes the outcome to
+// `out`. Plans on the calling thread; nothing changes unless every pair is valid.
+void reconfigurer_set(Reconfigurer *reconfigurer, char *arguments, FILE *out);
+// Writes the current settings to `out` in the form `set` takes
+void reconfigurer_dump(Reconfigurer *reconfigurer, FILE *out);
+
+// Render thread: consumes a `ready_fd` notification. Returns the waiting plan, owned by the caller, or NULL, and
+// copies a waiting theme name into `theme` (an empty string if there is none).
+struct cava_plan *reconfigurer_take(Reconfigurer *reconfigurer, char *theme, size_t size);
+// Render thread: hands back the plan a taken one replaced. FFTW's planner is not thread safe, so plans are only
+// created and destroyed on the control thread.
+void reconfigurer_retire(Reconfigurer *reconfigurer, struct cava_plan *plan);
+
+#endif // RECONFIGURE_H
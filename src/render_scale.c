@@ -0,0 +1,228 @@
+#include "render_scale.h"
+#include <math.h>
+#include <string.h>
+
+// Weight of the newest GPU time in the running average
+#define GPU_TIME_SMOOTHING 0.1
+// Timings collected at a scale before the governor judges it
+#define GOVERNOR_INTERVAL 30
+// Scale back up only once a draw takes less than this share of the budget, so we do not oscillate around it
+#define GOVERNOR_HEADROOM 0.6
+// Share of the budget a rescale aims for
+#define GOVERNOR_TARGET 0.85
+
+static bool has_extension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool render_scaler_init(RenderScaler *scaler, float scale, double budget)
+{
+    memset(scaler, 0, sizeof(*scaler));
+    scaler->initial_scale = scale;
+    scaler->budget = budget;
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        scaler->targets[i].scale = scale;
+        scaler->targets[i].gpu_time = -1.0;
+    }
+    if (budget <= 0.0)
+        return true;
+
+    if (has_extension("GL_EXT_disjoint_timer_query"))
+        scaler->get_query_u64 = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+    if (scaler->get_query_u64 == NULL)
+        return false;
+    for (int i = 0; i < MAX_MONITORS; i++)
+        glGenQueries(GPU_QUERY_COUNT, scaler->targets[i].queries);
+    return true;
+}
+
+static void release_target(ScaledTarget *target)
+{
+    if (target->framebuffer != 0)
+        glDeleteFramebuffers(1, &target->framebuffer);
+    if (target->texture != 0)
+        glDeleteTextures(1, &target->texture);
+    target->framebuffer = 0;
+    target->texture = 0;
+    target->width = 0;
+    target->height = 0;
+}
+
+void render_scaler_destroy(RenderScaler *scaler)
+{
+    for (int i = 0; i < MAX_MONITORS; i++)
+    {
+        release_target(&scaler->targets[i]);
+        if (scaler->get_query_u64 != NULL)
+            glDeleteQueries(GPU_QUERY_COUNT, scaler->targets[i].queries);
+    }
+}
+
+static bool ensure_target(ScaledTarget *target, int width, int height)
+{
+    if (target->framebuffer != 0 && target->width == width && target->height == height)
+        return true;
+    release_target(target);
+
+    glGenTextures(1, &target->texture);
+    glBindTexture(GL_TEXTURE_2D, target->texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &target->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        release_target(target);
+        return false;
+    }
+    target->width = width;
+    target->height = height;
+    return true;
+}
+
+static int scaled_size(int size, float scale)
+{
+    int scaled = (int)((float)size * scale + 0.5f);
+    return scaled > 0 ? scaled : 1;
+}
+
+float render_scaler_begin(RenderScaler *scaler, const MonitorData *monitor, int *width, int *height)
+{
+    ScaledTarget *target = &scaler->targets[monitor - platform.monitors];
+    if (target->output_name != monitor->name)
+    {
+        // The slot went to another output: start over from the configured scale
+        release_target(target);
+        target->output_name = monitor->name;
+        target->scale = scaler->initial_scale;
+        target->gpu_time = -1.0;
+        target->samples_since_change = 0;
+        target->query_pending = 0;
+    }
+
+    *width = monitor->surface_width;
+    *height = monitor->surface_height;
+    if (target->scale < 1.0f &&
+        ensure_target(target, scaled_size(*width, target->scale), scaled_size(*height, target->scale)))
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+        *width = target->width;
+        *height = target->height;
+    }
+    else
+    {
+        target->scale = 1.0f;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // With every query still in flight this frame goes untimed rather than waiting for a result
+    target->timing = scaler->get_query_u64 != NULL && target->query_pending < GPU_QUERY_COUNT;
+    if (target->timing)
+        glBeginQuery(GL_TIME_ELAPSED_EXT, target->queries[target->query_next]);
+    return target->scale;
+}
+
+// Reads back every finished query, oldest first, into the running average
+static void collect_gpu_times(RenderScaler *scaler, ScaledTarget *target)
+{
+    // A disjoint operation (power state change, reset) invalidates the results in flight
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    while (target->query_pending > 0)
+    {
+        int oldest = (target->query_next - target->query_pending + GPU_QUERY_COUNT) % GPU_QUERY_COUNT;
+        GLuint query = target->queries[oldest];
+        GLuint available = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 elapsed = 0;
+        scaler->get_query_u64(query, GL_QUERY_RESULT, &elapsed);
+        target->query_pending--;
+        if (disjoint)
+            continue;
+
+        double milliseconds = (double)elapsed / 1e6;
+        if (target->gpu_time < 0.0)
+            target->gpu_time = milliseconds;
+        else
+            target->gpu_time += GPU_TIME_SMOOTHING * (milliseconds - target->gpu_time);
+        target->samples_since_change++;
+    }
+}
+
+// The draw cost follows the pixel count, i.e. the square of the scale, so one step lands close to the target
+static void govern(RenderScaler *scaler, ScaledTarget *target)
+{
+    if (target->gpu_time < 0.0 || target->samples_since_change < GOVERNOR_INTERVAL)
+        return;
+
+    bool over = target->gpu_time > scaler->budget;
+    bool room = target->scale < 1.0f && target->gpu_time < GOVERNOR_HEADROOM * scaler->budget;
+    if (!over && !room)
+        return;
+
+    double gpu_time = target->gpu_time > 1e-3 ? target->gpu_time : 1e-3;
+    float scale = target->scale * (float)sqrt(GOVERNOR_TARGET * scaler->budget / gpu_time);
+    scale = roundf(scale / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+    if (scale < RENDER_SCALE_MIN)
+        scale = RENDER_SCALE_MIN;
+    if (scale > 1.0f)
+        scale = 1.0f;
+    if (fabsf(scale - target->scale) < 0.5f * RENDER_SCALE_STEP)
+        return;
+
+    // Timings from the old scale say nothing about the new one; queries still in flight are simply reissued
+    target->scale = scale;
+    target->gpu_time = -1.0;
+    target->samples_since_change = 0;
+    target->query_pending = 0;
+}
+
+void render_scaler_end(RenderScaler *scaler, const MonitorData *monitor, DamageRect repaint)
+{
+    ScaledTarget *target = &scaler->targets[monitor - platform.monitors];
+    if (target->timing)
+    {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        target->query_next = (target->query_next + 1) % GPU_QUERY_COUNT;
+        target->query_pending++;
+        target->timing = false;
+    }
+
+    if (target->scale < 1.0f)
+    {
+        // Bilinear stretch straight from the offscreen target, no extra shader pass. The scissor keeps the blit
+        // to what the surface's back buffer lacks, the target itself is complete.
+        int box[4];
+        damage_box(repaint, monitor->surface_width, monitor->surface_height, damage_margin(target->scale), box);
+        glScissor(box[0], box[1], box[2], box[3]);
+        glEnable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target->framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, target->width, target->height, 0, 0, monitor->surface_width, monitor->surface_height,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    if (scaler->get_query_u64 != NULL)
+    {
+        collect_gpu_times(scaler, target);
+        govern(scaler, target);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef RENDER_SCALE_H
+#define RENDER_SCALE_H
+
+#include <GLES3/gl31.h>
+#include <GLES2/gl2ext.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "damage.h"
+#include "platform.h"
+
+// The governor moves scales in steps of this size, down to RENDER_SCALE_MIN
+#define RENDER_SCALE_STEP 0.05f
+// Timer queries in flight per monitor; results are read a few frames late so nothing ever waits on the GPU
+#define GPU_QUERY_COUNT 4
+
+// Per-monitor state, indexed like platform.monitors
+typedef struct
+{
+    uint32_t output_name; // Registry name of the output this slot was set up for, 0 while unused
+    float scale;          // Fraction of the surface size the theme is drawn at, per axis
+
+    // Offscreen target the theme draws into while scale < 1, upscaled to the surface afterwards
+    GLuint framebuffer;
+    GLuint texture;
+    int width;
+    int height;
+
+    GLuint queries[GPU_QUERY_COUNT];
+    int query_next;    // Slot the next frame's query goes into
+    int query_pending; // Queries issued but not read back yet, the oldest `query_pending` slots before query_next
+    bool timing;       // A query is running for the frame between begin and end
+    double gpu_time;   // Smoothed GPU time of one draw at the current scale (ms), negative until measured
+    int samples_since_change;
+} ScaledTarget;
+
+// Draws each monitor's frame at a reduced resolution and stretches it over the surface. With a GPU budget set,
+// a governor measures the draw with GL_EXT_disjoint_timer_query and moves each monitor's scale so the draw
+// stays within the budget: quality degrades gradually instead of the wallpaper competing with foreground apps.
+typedef struct
+{
+    float initial_scale;
+    double budget; // GPU milliseconds per draw and monitor, 0 keeps every scale at initial_scale
+    PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_u64; // NULL without timer queries, which disables the governor
+    ScaledTarget targets[MAX_MONITORS];
+} RenderScaler;
+
+// Needs a current context. Returns false if the governor was asked for but the driver cannot time draws; the
+// scaler still works at the fixed `scale` then.
+bool render_scaler_init(RenderScaler *scaler, float scale, double budget);
+void render_scaler_destroy(RenderScaler *scaler);
+
+// Binds the framebuffer the monitor's frame has to be drawn into and returns the size to draw it at and its
+// scale. The offscreen target keeps its contents between frames as long as the scale and size stay the same.
+float render_scaler_begin(RenderScaler *scaler, const MonitorData *monitor, int *width, int *height);
+// Upscales the `repaint` part of the frame onto the monitor's surface and lets the governor adjust the scale
+void render_scaler_end(RenderScaler *scaler, const MonitorData *monitor, DamageRect repaint);
+
+#endif // RENDER_SCALE_H
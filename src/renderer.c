@@ -0,0 +1,101 @@
+#include "renderer.h"
+#include <stdio.h>
+#include <string.h>
+
+bool renderer_init(Renderer *renderer, const Theme *theme, GLuint program, int num_bars)
+{
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->theme = theme;
+    renderer->num_bars = num_bars;
+    if (program == 0)
+        return false;
+
+    glGenVertexArrays(1, &renderer->vao);
+    renderer_set_program(renderer, program);
+    return true;
+}
+
+void renderer_set_program(Renderer *renderer, GLuint program)
+{
+    if (renderer->program != 0)
+        glDeleteProgram(renderer->program);
+    renderer->program = program;
+
+    renderer->viewport_location = glGetUniformLocation(program, "u_viewport");
+    renderer->num_bars_location = glGetUniformLocation(program, "u_num_bars");
+    renderer->segments_location = glGetUniformLocation(program, "u_segments");
+    renderer->time_location = glGetUniformLocation(program, "u_time");
+    renderer->history_location = glGetUniformLocation(program, "u_history");
+    renderer->history_head_location = glGetUniformLocation(program, "u_history_head");
+
+    glUseProgram(program);
+    glUniform1i(renderer->num_bars_location, renderer->num_bars);
+    glUniform1i(renderer->segments_location, renderer->theme->segments);
+    glUniform1i(renderer->history_location, BAR_HISTORY_UNIT);
+    // Uniforms are per program, so the viewport is uploaded again on the next draw
+    renderer->width = 0;
+    renderer->height = 0;
+}
+
+void renderer_set_num_bars(Renderer *renderer, int num_bars)
+{
+    renderer->num_bars = num_bars;
+    glUseProgram(renderer->program);
+    glUniform1i(renderer->num_bars_location, num_bars);
+}
+
+void renderer_destroy(Renderer *renderer)
+{
+    glDeleteVertexArrays(1, &renderer->vao);
+    glDeleteProgram(renderer->program);
+    memset(renderer, 0, sizeof(*renderer));
+}
+
+// The context is shared by every monitor, so the viewport follows whichever surface is being drawn
+static void update_viewport(Renderer *renderer, int width, int height)
+{
+    if (renderer->width == width && renderer->height == height)
+        return;
+    renderer->width = width;
+    renderer->height = height;
+    glViewport(0, 0, width, height);
+    glUniform2f(renderer->viewport_location, (float)width, (float)height);
+}
+
+void renderer_draw(Renderer *renderer, int width, int height, float time, const int *clip)
+{
+    const Theme *theme = renderer->theme;
+
+    glUseProgram(renderer->program);
+    glBindVertexArray(renderer->vao);
+    update_viewport(renderer, width, height);
+    glUniform1f(renderer->time_location, time);
+    if (renderer->history)
+        glUniform1i(renderer->history_head_location, renderer->history->head);
+
+    if (clip)
+    {
+        glScissor(clip[0], clip[1], clip[2], clip[3]);
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    glClearColor(theme->clear_color[0], theme->clear_color[1], theme->clear_color[2], theme->clear_color[3]);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    switch (theme->mode)
+    {
+    case DRAW_FULLSCREEN:
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        break;
+    case DRAW_INSTANCED_BARS:
+        // Attribute-less: the vertex shader derives everything from gl_VertexID/gl_InstanceID and the bars
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (theme->segments + 1), renderer->num_bars);
+        break;
+    case DRAW_STRIP:
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 2 * ((renderer->num_bars - 1) * theme->segments + 1));
+        break;
+    }
+
+    if (clip)
+        glDisable(GL_SCISSOR_TEST);
+}
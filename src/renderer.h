@@ -0,0 +1,41 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <stdbool.h>
+
+#include "bar_history.h"
+#include "shader.h"
+#include "theme.h"
+
+typedef struct
+{
+    const Theme *theme;
+    GLuint program;
+    GLuint vao; // Empty: every draw is attribute-less, but core contexts still want a VAO bound
+    int num_bars;
+    const BarHistory *history; // Optional, exposed to the shaders as `u_history`; set before drawing
+
+    // Cached uniform locations
+    GLint viewport_location;
+    GLint num_bars_location;
+    GLint segments_location;
+    GLint time_location;
+    GLint history_location;
+    GLint history_head_location;
+
+    int width;
+    int height;
+} Renderer;
+
+// Takes ownership of `program`, linked from the theme's sources
+bool renderer_init(Renderer *renderer, const Theme *theme, GLuint program, int num_bars);
+void renderer_destroy(Renderer *renderer);
+// Swaps in a relinked program for the same theme and deletes the old one
+void renderer_set_program(Renderer *renderer, GLuint program);
+// Changes the number of bars drawn, for the next frame on
+void renderer_set_num_bars(Renderer *renderer, int num_bars);
+// Draws one frame with the bars currently bound to `CavaBuffer`. A `clip` box {x, y, width, height} restricts
+// the clear and the draw to that part of the framebuffer; NULL draws everything.
+void renderer_draw(Renderer *renderer, int width, int height, float time, const int *clip);
+
+#endif // RENDERER_H
@@ -4,8 +4,10 @@
 // Include the shader sources
 #include "circular.frag.h"
 #include "circular.vert.h"
+#include "fullscreen.vert.h"
 #include "spline.frag.h"
 #include "spline.vert.h"
+#include "waterfall.frag.h"
 
 GLuint compile_shader(GLenum type, const char *source, GLint length)
 {
@@ -25,45 +27,42 @@ GLuint compile_shader(GLenum type, const char *source, GLint length)
     return shader;
 }
 
-GLuint create_shader_program(const char *vertex_source, GLint vertex_len, const char *fragment_source,
-                             GLint fragment_len)
+bool link_shader_program(GLuint program, const char *vertex_source, GLint vertex_len, const char *fragment_source,
+                         GLint fragment_len)
 {
     GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source, vertex_len);
     GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source, fragment_len);
 
-    GLuint shader_program = glCreateProgram();
-    glAttachShader(shader_program, vertex_shader);
-    glAttachShader(shader_program, fragment_shader);
-    glLinkProgram(shader_program);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
 
     GLint success;
-    glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success)
     {
         char infoLog[512];
-        glGetProgramInfoLog(shader_program, 512, NULL, infoLog);
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
         printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
     }
 
+    // The shader objects are only flagged for deletion while attached; detaching frees them with the link done
+    glDetachShader(program, vertex_shader);
+    glDetachShader(program, fragment_shader);
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
-    return shader_program;
+    return success;
 }
 
-void construct_projection_matrix(float matrix[16], float left, float right, float bottom, float top, float near,
-                                 float far)
+GLuint create_shader_program(const char *vertex_source, GLint vertex_len, const char *fragment_source,
+                             GLint fragment_len)
 {
-    for (int i = 0; i < 16; i++)
+    GLuint shader_program = glCreateProgram();
+    if (!link_shader_program(shader_program, vertex_source, vertex_len, fragment_source, fragment_len))
     {
-        matrix[i] = 0.0f;
+        glDeleteProgram(shader_program);
+        return 0;
     }
-
-    matrix[0] = 2.0f / (right - left);
-    matrix[5] = 2.0f / (top - bottom);
-    matrix[10] = -2.0f / (far - near);
-    matrix[12] = -(right + left) / (right - left);
-    matrix[13] = -(top + bottom) / (top - bottom);
-    matrix[14] = -(far + near) / (far - near);
-    matrix[15] = 1.0f;
+    return shader_program;
 }
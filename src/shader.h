@@ -1,8 +1,8 @@
 #ifndef SHADER_H
 #define SHADER_H
 
-#include <GL/gl.h>
-#include <GLES3/gl3.h>
+#include <GLES3/gl31.h>
+#include <stdbool.h>
 
 // Shader data declared here, included in shader.c, automatically generated from shader files in the shaders/ folder
 extern unsigned char shaders_spline_frag[];
@@ -15,10 +15,19 @@ extern unsigned int shaders_circular_frag_len;
 extern unsigned char shaders_circular_vert[];
 extern unsigned int shaders_circular_vert_len;
 
+extern unsigned char shaders_waterfall_frag[];
+extern unsigned int shaders_waterfall_frag_len;
+
+extern unsigned char shaders_fullscreen_vert[];
+extern unsigned int shaders_fullscreen_vert_len;
+
 GLuint compile_shader(GLenum type, const char *source, GLint length);
+// Compiles both stages and links them into `program`, so callers can set program parameters beforehand.
+// Returns false, with the driver's log printed, when compiling or linking failed.
+bool link_shader_program(GLuint program, const char *vertex_source, GLint vertex_len, const char *fragment_source,
+                         GLint fragment_len);
+// Same as link_shader_program on a new program object; returns 0 on failure
 GLuint create_shader_program(const char *vertex_source, GLint vertex_len, const char *fragment_source,
                              GLint fragment_len);
-void construct_projection_matrix(float matrix[16], float left, float right, float bottom, float top, float near,
-                                 float far);
 
 #endif // SHADER_H
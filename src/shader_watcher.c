@@ -0,0 +1,171 @@
+#include "shader_watcher.h"
+#include "platform.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Editors save in several steps (truncate and write, or write a temporary and rename it), so a reload waits
+// until the directory has been quiet this long
+#define RELOAD_DEBOUNCE_MS 50
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+// True for `<theme>.vert` and `<theme>.frag`, the only files the theme is built from
+static bool is_theme_file(const ShaderWatcher *watcher, const char *file)
+{
+    size_t name_len = strlen(watcher->theme->name);
+    return strncmp(file, watcher->theme->name, name_len) == 0 &&
+           (strcmp(file + name_len, ".vert") == 0 || strcmp(file + name_len, ".frag") == 0);
+}
+
+// Reads every queued inotify event and reports whether one of them touched the theme's files
+static bool drain_events(ShaderWatcher *watcher)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(watcher->inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *p = buffer; p < buffer + length;)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && is_theme_file(watcher, event->name))
+                changed = true;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+static void reload(ShaderWatcher *watcher)
+{
+    GLuint program = program_cache_load_theme(watcher->cache, watcher->theme, watcher->shader_dir);
+    if (program == 0)
+    {
+        printf("Keeping the previous shaders for theme '%s'\n", watcher->theme->name);
+        return;
+    }
+    // Changes made in one context are only guaranteed to be visible to another once they completed
+    glFinish();
+
+    // A program the render thread never took is superseded; whoever swaps it out owns it
+    GLuint stale = atomic_exchange(&watcher->program, program);
+    if (stale != 0)
+        glDeleteProgram(stale);
+
+    uint64_t one = 1;
+    if (write(watcher->ready_fd, &one, sizeof(one)) < 0)
+    {
+        // The counter can only overflow after 2^64 - 1 unread reloads
+    }
+    printf("Reloaded shaders for theme '%s'\n", watcher->theme->name);
+}
+
+static void *shader_watcher_thread(void *arg)
+{
+    ShaderWatcher *watcher = arg;
+    if (eglBindAPI(EGL_OPENGL_ES_API) == EGL_FALSE ||
+        eglMakeCurrent(platform.egl.device, EGL_NO_SURFACE, EGL_NO_SURFACE, watcher->context) == EGL_FALSE)
+    {
+        printf("Shader reloading disabled: could not bind the loader context\n");
+        return NULL;
+    }
+
+    struct pollfd fds[2] = {
+        {.fd = watcher->inotify_fd, .events = POLLIN},
+        {.fd = watcher->stop_fd, .events = POLLIN},
+    };
+    bool dirty = false;
+    while (true)
+    {
+        int ready = poll(fds, 2, dirty ? RELOAD_DEBOUNCE_MS : -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+
+        if (ready == 0)
+        {
+            dirty = false;
+            reload(watcher);
+        }
+        else if (fds[0].revents & POLLIN)
+        {
+            dirty |= drain_events(watcher);
+        }
+    }
+
+    eglMakeCurrent(platform.egl.device, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+    return NULL;
+}
+
+static void close_watcher(ShaderWatcher *watcher)
+{
+    if (watcher->context != EGL_NO_CONTEXT)
+        eglDestroyContext(platform.egl.device, watcher->context);
+    if (watcher->inotify_fd >= 0)
+        close(watcher->inotify_fd);
+    if (watcher->stop_fd >= 0)
+        close(watcher->stop_fd);
+    if (watcher->ready_fd >= 0)
+        close(watcher->ready_fd);
+    watcher->context = EGL_NO_CONTEXT;
+    watcher->inotify_fd = watcher->stop_fd = watcher->ready_fd = -1;
+}
+
+bool shader_watcher_start(ShaderWatcher *watcher, const Theme *theme, const char *shader_dir, ProgramCache *cache)
+{
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->theme = theme;
+    watcher->cache = cache;
+    atomic_init(&watcher->program, 0);
+    snprintf(watcher->shader_dir, sizeof(watcher->shader_dir), "%s", shader_dir);
+
+    watcher->context = create_shared_context();
+    watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watcher->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    watcher->ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher->context == EGL_NO_CONTEXT || watcher->inotify_fd < 0 || watcher->stop_fd < 0 ||
+        watcher->ready_fd < 0 || inotify_add_watch(watcher->inotify_fd, shader_dir, WATCH_MASK) < 0 ||
+        pthread_create(&watcher->thread, NULL, shader_watcher_thread, watcher) != 0)
+    {
+        close_watcher(watcher);
+        return false;
+    }
+    return true;
+}
+
+void shader_watcher_stop(ShaderWatcher *watcher)
+{
+    uint64_t one = 1;
+    if (write(watcher->stop_fd, &one, sizeof(one)) < 0)
+    {
+        // Only fails if the counter is saturated, in which case the thread is woken anyway
+    }
+    pthread_join(watcher->thread, NULL);
+
+    GLuint program = atomic_exchange(&watcher->program, 0);
+    if (program != 0)
+        glDeleteProgram(program);
+    close_watcher(watcher);
+}
+
+GLuint shader_watcher_take(ShaderWatcher *watcher)
+{
+    uint64_t count;
+    if (read(watcher->ready_fd, &count, sizeof(count)) < 0)
+    {
+        // Nothing signalled; the exchange below still returns whatever is waiting
+    }
+    return atomic_exchange(&watcher->program, 0);
+}
@@ -0,0 +1,40 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <EGL/egl.h>
+#include <GLES3/gl31.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "program_cache.h"
+#include "theme.h"
+
+// Watches the user's shader directory with inotify and relinks the theme's program on its own thread, in a
+// context sharing objects with the render one, so saving a shader never stalls a frame. The render loop picks
+// the finished program up when `ready_fd` fires.
+typedef struct
+{
+    pthread_t thread;
+    EGLContext context;
+    int inotify_fd;
+    int stop_fd;  // eventfd asking the thread to exit
+    int ready_fd; // eventfd signalled once a relinked program is waiting
+
+    const Theme *theme;
+    ProgramCache *cache; // Only used by the watcher thread once it runs
+    char shader_dir[PATH_MAX];
+
+    atomic_uint program; // Relinked program the render thread has not taken yet, 0 if none
+} ShaderWatcher;
+
+// Returns false when the directory does not exist or the thread cannot be started; the theme then just keeps
+// the program it was started with
+bool shader_watcher_start(ShaderWatcher *watcher, const Theme *theme, const char *shader_dir, ProgramCache *cache);
+// Needs the render context current to free a program that was never taken
+void shader_watcher_stop(ShaderWatcher *watcher);
+// Consumes a `ready_fd` notification and returns the newest relinked program, owned by the caller, or 0
+GLuint shader_watcher_take(ShaderWatcher *watcher);
+
+#endif // SHADER_WATCHER_H
@@ -0,0 +1,183 @@
+#include "theme.h"
+#include "shader.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Wedge and disc outlines are approximated with this many segments per bar
+#define CIRCULAR_SEGMENTS 64
+// Catmull-Rom is evaluated this many times between two bars
+#define SPLINE_SEGMENTS 32
+
+static const Theme themes[] = {
+    {
+        .name = "circular",
+        .vertex_source = shaders_circular_vert,
+        .vertex_len = &shaders_circular_vert_len,
+        .fragment_source = shaders_circular_frag,
+        .fragment_len = &shaders_circular_frag_len,
+        .mode = DRAW_INSTANCED_BARS,
+        .segments = CIRCULAR_SEGMENTS,
+        .clear_color = {30 / 255.0f, 30 / 255.0f, 46 / 255.0f, 1.0f},
+        .damage = DAMAGE_RING,
+    },
+    {
+        .name = "spline",
+        .vertex_source = shaders_spline_vert,
+        .vertex_len = &shaders_spline_vert_len,
+        .fragment_source = shaders_spline_frag,
+        .fragment_len = &shaders_spline_frag_len,
+        .mode = DRAW_STRIP,
+        .segments = SPLINE_SEGMENTS,
+        .clear_color = {30 / 255.0f, 30 / 255.0f, 46 / 255.0f, 1.0f},
+        .damage = DAMAGE_CURVE,
+    },
+    {
+        // Reads past frames from the history texture instead of CavaBuffer, and scrolls every frame
+        .name = "waterfall",
+        .vertex_source = shaders_fullscreen_vert,
+        .vertex_len = &shaders_fullscreen_vert_len,
+        .fragment_source = shaders_waterfall_frag,
+        .fragment_len = &shaders_waterfall_frag_len,
+        .mode = DRAW_FULLSCREEN,
+        .clear_color = {30 / 255.0f, 30 / 255.0f, 46 / 255.0f, 1.0f},
+        .damage = DAMAGE_FULL,
+    },
+};
+
+// Template for themes that only exist as a fragment shader in the user's directory
+static const Theme fullscreen_theme = {
+    .vertex_source = shaders_fullscreen_vert,
+    .vertex_len = &shaders_fullscreen_vert_len,
+    .mode = DRAW_FULLSCREEN,
+    .clear_color = {0.0f, 0.0f, 0.0f, 1.0f},
+    .damage = DAMAGE_FULL,
+};
+
+#define NUM_THEMES (int)(sizeof(themes) / sizeof(themes[0]))
+
+// `<shader_dir>/<name>.<extension>`; names are used as file names, so anything with a slash is refused
+static bool theme_file(const char *shader_dir, const char *name, const char *extension, char *path, size_t size)
+{
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/') != NULL)
+        return false;
+    int written = snprintf(path, size, "%s/%s.%s", shader_dir, name, extension);
+    return written >= 0 && (size_t)written < size;
+}
+
+bool find_theme(const char *name, const char *shader_dir, Theme *theme)
+{
+    for (int i = 0; i < NUM_THEMES; i++)
+    {
+        if (strcmp(themes[i].name, name) == 0)
+        {
+            *theme = themes[i];
+            return true;
+        }
+    }
+
+    char path[PATH_MAX];
+    if (shader_dir && theme_file(shader_dir, name, "frag", path, sizeof(path)) && access(path, R_OK) == 0)
+    {
+        *theme = fullscreen_theme;
+        theme->name = name;
+        return true;
+    }
+    return false;
+}
+
+const char *theme_names(void)
+{
+    return "circular, spline, waterfall, or <name> for a <name>.frag in the shader directory";
+}
+
+DamageShape theme_damage_shape(const Theme *theme, const char *shader_dir)
+{
+    // An override can move the geometry, paint outside it or animate with u_time, none of which the bars predict
+    static const char *const stages[] = {"vert", "frag"};
+    char path[PATH_MAX];
+    for (int i = 0; shader_dir && i < 2; i++)
+    {
+        if (theme_file(shader_dir, theme->name, stages[i], path, sizeof(path)) && access(path, F_OK) == 0)
+            return DAMAGE_FULL;
+    }
+    return theme->damage;
+}
+
+// Reads a whole file into a NUL-terminated buffer. Returns 0 when the file does not exist, -1 on any other error.
+static int read_file(const char *path, char **data, int *length)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return access(path, F_OK) == 0 ? -1 : 0;
+
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0 || (*data = malloc((size_t)size + 1)) == NULL)
+    {
+        fclose(file);
+        return -1;
+    }
+    if (fread(*data, 1, (size_t)size, file) != (size_t)size)
+    {
+        free(*data);
+        *data = NULL;
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    (*data)[size] = '\0';
+    *length = (int)size;
+    return 1;
+}
+
+static bool load_stage(const Theme *theme, const char *shader_dir, const char *extension,
+                       const unsigned char *builtin, const unsigned int *builtin_len, char **data, int *length)
+{
+    char path[PATH_MAX];
+    if (shader_dir && theme_file(shader_dir, theme->name, extension, path, sizeof(path)))
+    {
+        int status = read_file(path, data, length);
+        if (status < 0)
+            printf("Could not read %s\n", path);
+        if (status != 0)
+            return status > 0;
+    }
+
+    if (builtin == NULL)
+    {
+        printf("Theme '%s' has no %s shader\n", theme->name, extension);
+        return false;
+    }
+    *data = malloc(*builtin_len + 1);
+    if (*data == NULL)
+        return false;
+    memcpy(*data, builtin, *builtin_len);
+    (*data)[*builtin_len] = '\0';
+    *length = (int)*builtin_len;
+    return true;
+}
+
+bool load_theme_sources(const Theme *theme, const char *shader_dir, ThemeSources *sources)
+{
+    memset(sources, 0, sizeof(*sources));
+    if (!load_stage(theme, shader_dir, "vert", theme->vertex_source, theme->vertex_len, &sources->vertex,
+                    &sources->vertex_len) ||
+        !load_stage(theme, shader_dir, "frag", theme->fragment_source, theme->fragment_len, &sources->fragment,
+                    &sources->fragment_len))
+    {
+        free_theme_sources(sources);
+        return false;
+    }
+    return true;
+}
+
+void free_theme_sources(ThemeSources *sources)
+{
+    free(sources->vertex);
+    free(sources->fragment);
+    memset(sources, 0, sizeof(*sources));
+}
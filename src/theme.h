@@ -0,0 +1,59 @@
+#ifndef THEME_H
+#define THEME_H
+
+#include <stdbool.h>
+
+typedef enum
+{
+    // One triangle over the whole surface (see shaders/fullscreen.vert); all the work happens per fragment
+    DRAW_FULLSCREEN,
+    // One triangle strip per bar (gl_InstanceID), built by the vertex shader from the bar values
+    DRAW_INSTANCED_BARS,
+    // A single triangle strip with `segments` columns per bar, built by the vertex shader
+    DRAW_STRIP,
+} DrawMode;
+
+// Which part of the surface a change in the bars can reach, so frames only repaint that (see damage.h)
+typedef enum
+{
+    DAMAGE_FULL,  // Unknown geometry, e.g. a time-driven fragment shader: every frame repaints everything
+    DAMAGE_RING,  // Wedges growing out of a centred circle, as in shaders/circular.vert
+    DAMAGE_CURVE, // A Catmull-Rom curve through the bars over the bottom edge, as in shaders/spline.vert
+} DamageShape;
+
+typedef struct
+{
+    const char *name;
+    const unsigned char *vertex_source;
+    const unsigned int *vertex_len; // Pointers so the xxd-generated lengths can sit in a static table
+    const unsigned char *fragment_source; // NULL for themes that only exist in the user's shader directory
+    const unsigned int *fragment_len;
+    DrawMode mode;
+    int segments;          // Strip subdivisions per bar (DRAW_INSTANCED_BARS and DRAW_STRIP)
+    float clear_color[4];  // Anything the geometry does not cover; 8-bit exact, so partial clears match full ones
+    DamageShape damage;
+} Theme;
+
+// Shader sources a theme is built from, copied so built-in and user files are freed alike
+typedef struct
+{
+    char *vertex;
+    int vertex_len;
+    char *fragment;
+    int fragment_len;
+} ThemeSources;
+
+// Copies the built-in theme called `name` into `theme`. Otherwise, when `shader_dir` (may be NULL) holds a
+// `<name>.frag`, `theme` becomes a full-screen theme drawing that fragment shader.
+bool find_theme(const char *name, const char *shader_dir, Theme *theme);
+const char *theme_names(void);
+// The theme's damage shape, or DAMAGE_FULL once `<shader_dir>/<name>.vert` or `.frag` overrides a stage of it
+DamageShape theme_damage_shape(const Theme *theme, const char *shader_dir);
+
+// Reads `<shader_dir>/<name>.vert` and `<name>.frag` where they exist and falls back to the built-in source of
+// each stage otherwise. Returns false, with a message printed, when a file cannot be read or a stage has no
+// source at all.
+bool load_theme_sources(const Theme *theme, const char *shader_dir, ThemeSources *sources);
+void free_theme_sources(ThemeSources *sources);
+
+#endif // THEME_H
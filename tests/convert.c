@@ -0,0 +1,129 @@
+// Checks every input conversion kernel against a scalar reference, on unaligned input, at both ends of the
+// full scale and across the wrap point of the input ring. Exits with 1 on the first kernel that disagrees.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+#define SAMPLES 1027 // Odd, so the vectorized loops also run their scalar tail
+#define RING_CAPACITY 256
+
+typedef struct
+{
+    const char *name;
+    int format;
+    int sample_bytes;
+    int ieee_float;
+    int64_t min, max; // Full scale of the integer formats
+} Format;
+
+static const Format formats[] = {
+    {"s8", 8, 1, 0, INT8_MIN, INT8_MAX},
+    {"s16", 16, 2, 0, INT16_MIN, INT16_MAX},
+    {"s24", 24, 3, 0, -(1 << 23), (1 << 23) - 1},
+    {"s24_32", 24, 4, 0, -(1 << 23), (1 << 23) - 1},
+    {"s32", 32, 4, 0, INT32_MIN, INT32_MAX},
+    {"f32", 32, 4, 1, 0, 0},
+};
+
+static uint32_t random_state = 0x12345678u;
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// Writes sample `i` in the stream's byte layout and returns what it should convert to: the value scaled so
+// that full scale matches int16, computed the slow way
+static double put_sample(const Format *format, unsigned char *out, int i)
+{
+    if (format->ieee_float)
+    {
+        float v = i == 0 ? -1.0f : i == 1 ? 1.0f : (float)((double)next_random() / UINT32_MAX * 2.0 - 1.0);
+        memcpy(out, &v, sizeof(v));
+        return (double)v * 32768.0;
+    }
+
+    int64_t range = format->max - format->min + 1;
+    int64_t v = i == 0 ? format->min : i == 1 ? format->max : format->min + (int64_t)next_random() % range;
+    uint32_t bits = (uint32_t)v;
+    for (int b = 0; b < format->sample_bytes; b++)
+        out[b] = (unsigned char)(bits >> (8 * b));
+    // The padding byte of 24 bit in 32 is not guaranteed to be a sign extension
+    if (format->format == 24 && format->sample_bytes == 4)
+        out[3] = (unsigned char)next_random();
+    return (double)v * 32768.0 / (double)(format->max + 1);
+}
+
+static bool check(const Format *format, const char *what, const cava_real *got, const double *expected, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (got[i] != (cava_real)expected[i])
+        {
+            printf("%s %s: sample %d is %.9g, expected %.9g\n", format->name, what, i, (double)got[i],
+                   expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_format(const Format *format)
+{
+    static unsigned char storage[SAMPLES * 4 + 1];
+    static double expected[SAMPLES];
+    static cava_real out[SAMPLES];
+
+    // Offset by one byte, so every multi-byte sample is misaligned
+    unsigned char *in = storage + 1;
+    for (int i = 0; i < SAMPLES; i++)
+        expected[i] = put_sample(format, in + (size_t)i * format->sample_bytes, i);
+
+    struct audio_data audio = {0};
+    audio.format = format->format;
+    audio.sample_bytes = format->sample_bytes;
+    audio.IEEE_FLOAT = format->ieee_float;
+    audio.channels = 2;
+    cava_convert_fn convert = select_cava_input_converter(&audio);
+    convert(out, in, SAMPLES);
+    if (!check(format, "kernel", out, expected, SAMPLES))
+        return false;
+
+    // Through the ring: fill most of it and drain it, so the next write straddles the end of the buffer
+    if (init_cava_input_ring(&audio.ring, RING_CAPACITY) != 0)
+    {
+        printf("%s: could not allocate the ring\n", format->name);
+        return false;
+    }
+    int lead = RING_CAPACITY - 38;
+    int wrapped = 76;
+    bool ok = true;
+    write_to_cava_input_buffers(lead, in, &audio);
+    ok = read_from_cava_input_buffers(&audio, out, SAMPLES) == lead && check(format, "ring", out, expected, lead);
+    if (ok)
+    {
+        write_to_cava_input_buffers(wrapped, in, &audio);
+        ok = read_from_cava_input_buffers(&audio, out, SAMPLES) == wrapped &&
+             check(format, "wrapped ring", out, expected, wrapped);
+    }
+    free_cava_input_ring(&audio.ring);
+    return ok;
+}
+
+int main(void)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        bool ok = test_format(&formats[i]);
+        printf("%-7s %s\n", formats[i].name, ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed == 0 ? 0 : 1;
+}